@@ -0,0 +1,287 @@
+//
+//  AllocationTrace.hpp
+//  PoolAllocator
+//
+//  Copyright (c) 2017 Mike Allison. All rights reserved.
+//
+
+#pragma once
+
+//--------------------------------------------------------------------------------------------------
+// Records every allocate() and deallocate() that goes through an Allocator into a binary trace
+// file, so real traffic can be replayed offline against every policy (see bench/replay.cpp).
+//
+// Build with MEM_TRACE_ALLOCATIONS defined to compile the hooks into Allocator, then bracket the
+// interesting part of the run with AllocationTrace::get().start(path) and stop().  While no trace is
+// recording the hooks cost one relaxed load.  While recording, events are appended to a buffer under
+// a mutex, which also gives them the one global order a replay needs: an object's alloc is written
+// after the policy handed it out and its free before the policy takes it back.
+//
+// The file is the magic "MEMTRACE", a version byte, then one event after another.  Every event is an
+// op byte followed by unsigned LEB128 varints:
+//
+//   TRACE_POLICY  id, name length, name bytes           the first time a policy shows up
+//   TRACE_ALLOC   time delta, thread, policy, object delta, object size, count, alignment
+//   TRACE_FREE    time delta, thread, policy, object delta, object size, count, alignment
+//
+// Times are nanoseconds since start(), stored as the difference to the previous event.  Objects are
+// identified by address, stored zigzagged as the difference to the previous event's address, so a
+// typical event takes around a dozen bytes.  An address is reused as soon as it is freed, the
+// replay maps each alloc-free pair to an object of its own.  Threads are numbered in the order they
+// first allocate.
+//--------------------------------------------------------------------------------------------------
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "PoolRegistry.hpp"
+
+namespace mem {
+
+	enum TraceOp {
+		TRACE_ALLOC,
+		TRACE_FREE,
+		TRACE_POLICY
+	};
+
+	struct TraceEvent
+	{
+		TraceOp op;
+		uint64_t time;  // nanoseconds since the trace started
+		uint32_t thread;
+		uint32_t policy;  // index into the policy names
+		uint64_t object;  // the address
+		size_t size;  // sizeof one object
+		size_t count;  // objects in the allocation
+		size_t alignment;
+	};
+
+	class AllocationTrace
+	{
+	public:
+
+		constexpr static const char* MAGIC = "MEMTRACE";
+		constexpr static const unsigned char VERSION = 1;
+
+		// never destroyed, allocations can happen during static destruction
+		static AllocationTrace& get() {
+			static AllocationTrace* sInstance = new AllocationTrace;
+			return *sInstance;
+		}
+
+		// start writing a new trace to path, stopping any trace already recording
+		bool start(const std::string& path) {
+			std::lock_guard<std::mutex> lock(mMutex);
+			stopLocked();
+			mFile = fopen(path.c_str(), "wb");
+			if (!mFile)
+				return false;
+			fwrite(MAGIC, 1, strlen(MAGIC), mFile);
+			fputc(VERSION, mFile);
+			mStart = std::chrono::steady_clock::now();
+			mLastTime = 0;
+			mLastObject = 0;
+			mNumEvents = 0;
+			mWrittenPolicies.assign(mPolicyNames.size(), false);
+			static bool sAtExit = std::atexit([] { AllocationTrace::get().stop(); }) == 0;
+			(void)sAtExit;
+			mRecording.store(true, std::memory_order_release);
+			return true;
+		}
+
+		// flush and close the trace, returns the number of events written
+		uint64_t stop() {
+			std::lock_guard<std::mutex> lock(mMutex);
+			uint64_t events = mNumEvents;
+			stopLocked();
+			return events;
+		}
+
+		bool isRecording() const { return mRecording.load(std::memory_order_relaxed); }
+
+		template<typename PolicyT>
+		void recordAlloc(const void* ptr, size_t size, size_t count, size_t alignment) {
+			if (isRecording() && ptr)
+				record(TRACE_ALLOC, policyId<PolicyT>(), ptr, size, count, alignment);
+		}
+
+		template<typename PolicyT>
+		void recordFree(const void* ptr, size_t size, size_t count, size_t alignment) {
+			if (isRecording() && ptr)
+				record(TRACE_FREE, policyId<PolicyT>(), ptr, size, count, alignment);
+		}
+
+		// the whole of a trace file, false if it isn't one or is cut short
+		static bool read(const std::string& path, std::vector<TraceEvent>& events, std::vector<std::string>& policyNames) {
+			FILE* file = fopen(path.c_str(), "rb");
+			if (!file)
+				return false;
+			std::vector<unsigned char> data;
+			unsigned char buffer[65536];
+			for (size_t count; (count = fread(buffer, 1, sizeof(buffer), file)) > 0; )
+				data.insert(data.end(), buffer, buffer + count);
+			fclose(file);
+
+			size_t magic = strlen(MAGIC);
+			if (data.size() < magic + 1 || memcmp(data.data(), MAGIC, magic) != 0 || data[magic] != VERSION)
+				return false;
+
+			const unsigned char* cursor = data.data() + magic + 1;
+			const unsigned char* end = data.data() + data.size();
+			uint64_t time = 0;
+			uint64_t object = 0;
+			bool ok = true;
+			while (ok && cursor < end) {
+				TraceOp op = (TraceOp)*cursor++;
+				if (op == TRACE_POLICY) {
+					uint64_t id = readVarint(cursor, end, ok);
+					uint64_t length = readVarint(cursor, end, ok);
+					if (!ok || length > (uint64_t)(end - cursor))
+						return false;
+					if (policyNames.size() <= id)
+						policyNames.resize(id + 1);
+					policyNames[id].assign((const char*)cursor, length);
+					cursor += length;
+					continue;
+				}
+				if (op != TRACE_ALLOC && op != TRACE_FREE)
+					return false;
+
+				TraceEvent event;
+				event.op = op;
+				time += readVarint(cursor, end, ok);
+				event.time = time;
+				event.thread = (uint32_t)readVarint(cursor, end, ok);
+				event.policy = (uint32_t)readVarint(cursor, end, ok);
+				uint64_t delta = readVarint(cursor, end, ok);
+				object += (delta >> 1) ^ (0 - (delta & 1));
+				event.object = object;
+				event.size = (size_t)readVarint(cursor, end, ok);
+				event.count = (size_t)readVarint(cursor, end, ok);
+				event.alignment = (size_t)readVarint(cursor, end, ok);
+				if (ok)
+					events.push_back(event);
+			}
+			return ok;
+		}
+
+	private:
+
+		constexpr static const size_t FLUSH_BYTES = 1 << 20;
+
+		AllocationTrace() = default;
+
+		// a small number per policy type, handed out the first time the type records anything
+		template<typename PolicyT>
+		uint32_t policyId() {
+			static const uint32_t sId = addPolicy(type_name<PolicyT>());
+			return sId;
+		}
+
+		uint32_t addPolicy(const std::string& name) {
+			std::lock_guard<std::mutex> lock(mMutex);
+			mPolicyNames.push_back(name);
+			mWrittenPolicies.push_back(false);
+			return (uint32_t)(mPolicyNames.size() - 1);
+		}
+
+		static uint32_t threadId() {
+			static std::atomic<uint32_t> sNextThread{ 0 };
+			static thread_local uint32_t tThread = sNextThread.fetch_add(1, std::memory_order_relaxed);
+			return tThread;
+		}
+
+		void record(TraceOp op, uint32_t policy, const void* ptr, size_t size, size_t count, size_t alignment) {
+			uint32_t thread = threadId();
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (!mFile)
+				return;
+
+			if (!mWrittenPolicies[policy]) {
+				const std::string& name = mPolicyNames[policy];
+				mBuffer.push_back(TRACE_POLICY);
+				writeVarint(policy);
+				writeVarint(name.size());
+				mBuffer.insert(mBuffer.end(), name.begin(), name.end());
+				mWrittenPolicies[policy] = true;
+			}
+
+			uint64_t time = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - mStart).count();
+			time = time > mLastTime ? time : mLastTime;
+			uint64_t object = (uint64_t)(uintptr_t)ptr;
+			int64_t delta = (int64_t)(object - mLastObject);
+
+			mBuffer.push_back((unsigned char)op);
+			writeVarint(time - mLastTime);
+			writeVarint(thread);
+			writeVarint(policy);
+			writeVarint(((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+			writeVarint(size);
+			writeVarint(count);
+			writeVarint(alignment);
+			mLastTime = time;
+			mLastObject = object;
+			++mNumEvents;
+
+			if (mBuffer.size() >= FLUSH_BYTES)
+				flushLocked();
+		}
+
+		void writeVarint(uint64_t value) {
+			while (value >= 0x80) {
+				mBuffer.push_back((unsigned char)(value | 0x80));
+				value >>= 7;
+			}
+			mBuffer.push_back((unsigned char)value);
+		}
+
+		static uint64_t readVarint(const unsigned char*& cursor, const unsigned char* end, bool& ok) {
+			uint64_t value = 0;
+			for (unsigned int shift = 0; shift < 64; shift += 7) {
+				if (cursor == end) {
+					ok = false;
+					return 0;
+				}
+				unsigned char byte = *cursor++;
+				value |= (uint64_t)(byte & 0x7f) << shift;
+				if (!(byte & 0x80))
+					return value;
+			}
+			ok = false;
+			return 0;
+		}
+
+		void flushLocked() {
+			if (mFile && !mBuffer.empty())
+				fwrite(mBuffer.data(), 1, mBuffer.size(), mFile);
+			mBuffer.clear();
+		}
+
+		void stopLocked() {
+			mRecording.store(false, std::memory_order_release);
+			flushLocked();
+			if (mFile)
+				fclose(mFile);
+			mFile = nullptr;
+		}
+
+		std::mutex mMutex;
+		std::atomic<bool> mRecording{ false };
+		FILE* mFile{ nullptr };
+		std::vector<unsigned char> mBuffer;
+		std::chrono::steady_clock::time_point mStart;
+		uint64_t mLastTime{ 0 };
+		uint64_t mLastObject{ 0 };
+		uint64_t mNumEvents{ 0 };
+		std::vector<std::string> mPolicyNames;
+		std::vector<bool> mWrittenPolicies;  // in the current trace
+	};
+
+}
@@ -11,6 +11,9 @@
 #include "ObjectTraits.hpp"
 #include "AllocatorTraits.hpp"
 #include "HeapPolicy.hpp"
+#ifdef MEM_TRACE_ALLOCATIONS
+#include "AllocationTrace.hpp"
+#endif
 
 #define FORWARD_ALLOCATOR_TRAITS(C)                  \
 typedef typename C::value_type      value_type;      \
@@ -56,6 +59,22 @@ public:
 	Policy(other),
 	Traits(other)
 	{}
+
+#ifdef MEM_TRACE_ALLOCATIONS
+	// the policy does the work, the trace just watches, see AllocationTrace.hpp
+	pointer allocate(size_type count, const_pointer hint = 0)
+	{
+		pointer ptr = Policy::allocate(count, hint);
+		mem::AllocationTrace::get().template recordAlloc<Policy>(ptr, sizeof(value_type), count, alignof(value_type));
+		return ptr;
+	}
+
+	void deallocate(pointer ptr, size_type count)
+	{
+		mem::AllocationTrace::get().template recordFree<Policy>(ptr, sizeof(value_type), count, alignof(value_type));
+		Policy::deallocate(ptr, count);
+	}
+#endif
 };
 
 // Two allocators are not equal unless a specialization says so
@@ -0,0 +1,102 @@
+//
+//  BlockOccupancy.hpp
+//  PoolAllocator
+//
+//  Copyright (c) 2017 Mike Allison. All rights reserved.
+//
+
+#pragma once
+
+//--------------------------------------------------------------------------------------------------
+// How the live objects of a pool are spread over its blocks, to tell a pool that is just big from
+// one whose objects are scattered thinly over many blocks that trim() can never give back.
+//
+// The fragmentation index is the share of the chunks in blocks holding at least one live object
+// that are free: 0 when every occupied block is full, towards 1 when a few live objects pin down
+// many blocks.  Empty and decommitted blocks don't count, trim() can already deal with those.
+//
+// occupancy_map() draws one character per block, emptiest to fullest:
+//
+//   ~  decommitted   .  empty   : - = + * # %  in sevenths of the block   @  full
+//--------------------------------------------------------------------------------------------------
+
+#include <stddef.h>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace mem {
+
+	struct BlockUsage
+	{
+		size_t numObjects;  // chunks in the block
+		size_t liveObjects;  // chunks handed out and not freed yet
+		size_t uncarved;  // free chunks that were never handed out at all
+		size_t longestFreeRun;  // the most free chunks next to each other
+		bool decommitted;  // trimmed, the block holds no pages until the pool reuses it
+	};
+
+	inline double fragmentation_index(const std::vector<BlockUsage>& blocks) {
+		size_t chunks = 0;
+		size_t free = 0;
+		for (const BlockUsage& block : blocks) {
+			if (block.decommitted || !block.liveObjects)
+				continue;
+			chunks += block.numObjects;
+			free += block.numObjects - block.liveObjects;
+		}
+		return chunks ? (double)free / chunks : 0;
+	}
+
+	inline char occupancy_cell(const BlockUsage& block) {
+		static const char sLevels[] = ":-=+*#%";
+		if (block.decommitted)
+			return '~';
+		if (!block.liveObjects)
+			return '.';
+		if (block.liveObjects >= block.numObjects)
+			return '@';
+		return sLevels[std::min<size_t>(6, block.liveObjects * 7 / block.numObjects)];
+	}
+
+	// a summary line, blocks counted by how full they are, and one cell per block, width to a row
+	inline std::string occupancy_map(const std::string& title, const std::vector<BlockUsage>& blocks, unsigned int width = 64) {
+		size_t live = 0;
+		size_t chunks = 0;
+		size_t empty = 0;
+		size_t decommitted = 0;
+		size_t buckets[6] = { 0, 0, 0, 0, 0, 0 };  // empty, up to 25%, 50%, 75%, under 100%, full
+		for (const BlockUsage& block : blocks) {
+			if (block.decommitted) {
+				++decommitted;
+				continue;
+			}
+			live += block.liveObjects;
+			chunks += block.numObjects;
+			if (!block.liveObjects)
+				++empty;
+			if (!block.liveObjects || block.liveObjects >= block.numObjects)
+				++buckets[block.liveObjects ? 5 : 0];
+			else
+				++buckets[1 + std::min<size_t>(3, block.liveObjects * 4 / block.numObjects)];
+		}
+
+		std::ostringstream str;
+		str << title << ": " << blocks.size() << " blocks, " << empty << " empty, " << decommitted << " decommitted, "
+			<< live << " live / " << chunks << " chunks, fragmentation " << std::fixed << std::setprecision(3)
+			<< fragmentation_index(blocks) << "\n";
+		str << "blocks by occupancy: [0%] " << buckets[0] << "  [<25%] " << buckets[1] << "  [<50%] " << buckets[2]
+			<< "  [<75%] " << buckets[3] << "  [<100%] " << buckets[4] << "  [100%] " << buckets[5] << "\n";
+		width = width ? width : 64;
+		for (size_t row = 0; row < blocks.size(); row += width) {
+			str << std::setw(6) << row << " ";
+			for (size_t i = row; i < std::min(blocks.size(), row + width); ++i)
+				str << occupancy_cell(blocks[i]);
+			str << "\n";
+		}
+		return str.str();
+	}
+
+}
@@ -0,0 +1,207 @@
+//
+//  BlockProvider.hpp
+//  PoolAllocator
+//
+//  Copyright (c) 2017 Mike Allison. All rights reserved.
+//
+
+#pragma once
+
+//--------------------------------------------------------------------------------------------------
+// Block providers decide where the blocks of a pool come from.  A provider is a type with
+//
+//   static void* allocate(size_t size, size_t alignment)             nullptr when out of memory
+//   static void  deallocate(void* memory, size_t size, size_t alignment)  same size and alignment
+//   static bool  decommit(void* memory, size_t size, bool lazy)      drop the pages, keep the range
+//   static size_t granularity()                                      blocks are best a multiple of this
+//   constexpr static const bool HUGE_PAGES                           blocks are backed by huge pages
+//
+//  malloc_provider: the C++ heap, what pools have always used.
+//
+//  mmap_provider:   anonymous private mappings straight from the kernel.  Blocks start on a page
+//                   boundary and go back to the OS the moment they are freed.  The flags add:
+//
+//      MMAP_POPULATE                prefault the whole block up front (MAP_POPULATE), so the fast
+//                                   path never takes a page fault on a fresh block
+//      MMAP_HUGE_TLB                explicit huge pages from the hugetlbfs pool (MAP_HUGETLB), falls
+//                                   back to transparent huge pages when none are reserved
+//      MMAP_TRANSPARENT_HUGE_PAGES  blocks are aligned to a huge page and madvise(MADV_HUGEPAGE)d so
+//                                   the kernel backs them with huge pages when it can
+//
+// Huge pages are the big one for large pools of small nodes: with 4KB pages every few dozen nodes
+// need a TLB entry of their own, one 2MB page covers a whole block.  The huge page providers round
+// every block up to a whole huge page, so the pool sizes its blocks to fill them.
+//
+// Where there is no mmap the mmap providers fall back to the heap.
+//--------------------------------------------------------------------------------------------------
+
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define MEM_HAS_MMAP 1
+#else
+#define MEM_HAS_MMAP 0
+#endif
+
+namespace mem {
+
+	constexpr static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+	inline size_t page_size() {
+#if MEM_HAS_MMAP
+		static const size_t size = (size_t)sysconf(_SC_PAGESIZE);
+		return size;
+#else
+		return 4096;
+#endif
+	}
+
+	// give the whole pages inside [memory, memory + size) back to the OS but keep the range, false
+	// when the platform can't
+	inline bool decommit_pages(void* memory, size_t size, bool lazy) {
+#if MEM_HAS_MMAP
+		uintptr_t begin = ((uintptr_t)memory + page_size() - 1) & ~(uintptr_t)(page_size() - 1);
+		uintptr_t end = ((uintptr_t)memory + size) & ~(uintptr_t)(page_size() - 1);
+		if (begin >= end)
+			return true;
+#ifdef MADV_FREE
+		if (lazy && madvise((void*)begin, end - begin, MADV_FREE) == 0)
+			return true;
+#endif
+		return madvise((void*)begin, end - begin, MADV_DONTNEED) == 0;
+#else
+		return false;
+#endif
+	}
+
+	struct malloc_provider
+	{
+		constexpr static const bool HUGE_PAGES = false;
+
+		static void* allocate(size_t size, size_t alignment) {
+			if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+				return ::operator new(size, std::align_val_t(alignment), std::nothrow);
+			return ::operator new(size, std::nothrow);
+		}
+
+		static void deallocate(void* memory, size_t, size_t alignment) {
+			if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+				::operator delete(memory, std::align_val_t(alignment));
+			else
+				::operator delete(memory);
+		}
+
+		static bool decommit(void* memory, size_t size, bool lazy) { return decommit_pages(memory, size, lazy); }
+		static size_t granularity() { return 1; }
+	};
+
+	enum MmapFlags {
+		MMAP_POPULATE = 1,
+		MMAP_HUGE_TLB = 2,
+		MMAP_TRANSPARENT_HUGE_PAGES = 4
+	};
+
+	template<unsigned int flags = 0>
+	struct mmap_provider
+	{
+		constexpr static const bool HUGE_PAGES = (flags & (MMAP_HUGE_TLB | MMAP_TRANSPARENT_HUGE_PAGES)) != 0;
+
+		static size_t granularity() { return HUGE_PAGES ? HUGE_PAGE_SIZE : page_size(); }
+
+		static void* allocate(size_t size, size_t alignment) {
+#if MEM_HAS_MMAP
+			size_t length = roundUp(size);
+			void* memory = nullptr;
+#ifdef MAP_HUGETLB
+			// hugetlb mappings always start on a huge page
+			if ((flags & MMAP_HUGE_TLB) && alignment <= HUGE_PAGE_SIZE) {
+				memory = mmap(nullptr, length, PROT_READ | PROT_WRITE, mapFlags() | MAP_HUGETLB, -1, 0);
+				if (memory == MAP_FAILED)
+					memory = nullptr;
+			}
+#endif
+			if (!memory) {
+				memory = mapAligned(length, HUGE_PAGES && alignment < HUGE_PAGE_SIZE ? HUGE_PAGE_SIZE : alignment);
+				if (!memory)
+					return nullptr;
+#ifdef MADV_HUGEPAGE
+				if (HUGE_PAGES)
+					madvise(memory, length, MADV_HUGEPAGE);
+#endif
+			}
+			// MAP_POPULATE only covers the plain case, the others prefault here so the huge page advice
+			// is in place before the first touch
+			if ((flags & MMAP_POPULATE) && (HUGE_PAGES || alignment > page_size())) {
+				for (size_t offset = 0; offset < length; offset += page_size())
+					static_cast<volatile unsigned char*>(memory)[offset] = 0;
+			}
+			return memory;
+#else
+			return malloc_provider::allocate(size, alignment);
+#endif
+		}
+
+		static void deallocate(void* memory, size_t size, size_t alignment) {
+#if MEM_HAS_MMAP
+			(void)alignment;
+			munmap(memory, roundUp(size));
+#else
+			malloc_provider::deallocate(memory, size, alignment);
+#endif
+		}
+
+		static bool decommit(void* memory, size_t size, bool lazy) { return decommit_pages(memory, size, lazy); }
+
+	private:
+
+		static size_t roundUp(size_t size) { return (size + granularity() - 1) & ~(granularity() - 1); }
+
+#if MEM_HAS_MMAP
+		static int mapFlags() {
+			int mapFlags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_POPULATE
+			if ((flags & MMAP_POPULATE) && !HUGE_PAGES)
+				mapFlags |= MAP_POPULATE;
+#endif
+			return mapFlags;
+		}
+
+		// mmap only promises page alignment, anything more is mapped oversized and the ends cut off
+		static void* mapAligned(size_t length, size_t alignment) {
+			if (alignment <= page_size()) {
+				void* memory = mmap(nullptr, length, PROT_READ | PROT_WRITE, mapFlags(), -1, 0);
+				return memory == MAP_FAILED ? nullptr : memory;
+			}
+
+			size_t padded = length + alignment - page_size();
+			void* raw = mmap(nullptr, padded, PROT_READ | PROT_WRITE, mapFlags() & ~populateFlag(), -1, 0);
+			if (raw == MAP_FAILED)
+				return nullptr;
+			uintptr_t begin = ((uintptr_t)raw + alignment - 1) & ~(uintptr_t)(alignment - 1);
+			uintptr_t end = begin + length;
+			if (begin > (uintptr_t)raw)
+				munmap(raw, begin - (uintptr_t)raw);
+			if ((uintptr_t)raw + padded > end)
+				munmap((void*)end, (uintptr_t)raw + padded - end);
+			return (void*)begin;
+		}
+
+		static int populateFlag() {
+#ifdef MAP_POPULATE
+			return MAP_POPULATE;
+#else
+			return 0;
+#endif
+		}
+#endif
+	};
+
+	typedef mmap_provider<> anonymous_mmap_provider;
+	typedef mmap_provider<MMAP_POPULATE> populated_mmap_provider;
+	typedef mmap_provider<MMAP_HUGE_TLB> huge_page_provider;
+	typedef mmap_provider<MMAP_TRANSPARENT_HUGE_PAGES> transparent_huge_page_provider;
+
+}
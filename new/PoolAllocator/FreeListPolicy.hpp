@@ -0,0 +1,224 @@
+//
+//  FreeListPolicy.hpp
+//  PoolAllocator
+//
+//  Copyright (c) 2017 Mike Allison. All rights reserved.
+//
+
+#pragma once
+
+//--------------------------------------------------------------------------------------------------
+// Free list policies for mem::MemoryPool.  A free list is a singly-linked stack of chunks where the
+// link lives in the first pointer-sized bytes of each free chunk.
+//
+//  basic_free_list: a plain head pointer.  The pool is not thread safe, same as it always was.
+//
+//  lock_free_list:  a Treiber stack.  alloc() and free() are a single compare-and-swap on the head,
+//                   and the pool only takes a mutex on the slow path when it has to grow.  The head
+//                   carries a version tag next to the pointer that is bumped on every successful
+//                   swap, so a pop that read a stale head (the chunk was popped, reused and pushed
+//                   back by other threads in the meantime) fails its CAS instead of corrupting the
+//                   list.
+//
+//                   Where the compiler has a double-width CAS (cmpxchg16b on x86-64, built with
+//                   -mcx16) the head is the full pointer next to a 64-bit tag.  Anywhere else both
+//                   are packed into one 64-bit word: the low 48 bits of the pointer and a 16-bit
+//                   tag.  That assumes user space addresses fit in 48 bits, which stops holding on
+//                   kernels with 5-level paging once something maps memory above 47 bits (Linux
+//                   only does that for mmap calls that ask for it); debug builds assert every
+//                   pointer survives the packing.  The tag also only protects a stalled pop until
+//                   it wraps: with 16 bits, a pop that sleeps between reading the head and its CAS
+//                   while exactly a multiple of 65536 other swaps happen, and finds the same chunk
+//                   back on top, succeeds against a stale link.  With 64 bits that can't happen.
+//--------------------------------------------------------------------------------------------------
+
+#include <assert.h>
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+
+#if defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16) && UINTPTR_MAX == UINT64_MAX
+#define MEM_HAS_DOUBLE_WIDTH_CAS 1
+#else
+#define MEM_HAS_DOUBLE_WIDTH_CAS 0
+#endif
+
+namespace mem {
+
+	// stands in for std::mutex when the pool doesn't need to lock anything
+	struct null_mutex
+	{
+		void lock() {}
+		void unlock() {}
+		bool try_lock() { return true; }
+	};
+
+	class basic_free_list
+	{
+	public:
+
+		typedef null_mutex mutex_type;
+
+		constexpr static const bool IS_CONCURRENT = false;
+
+		bool empty() const { return mHead == nullptr; }
+		unsigned char* front() const { return mHead; }
+		void clear() { mHead = nullptr; }
+
+		// detach the whole list, it is left empty
+		unsigned char* takeAll() {
+			unsigned char* chunk = mHead;
+			mHead = nullptr;
+			return chunk;
+		}
+
+		unsigned char* pop() {
+			unsigned char* chunk = mHead;
+			if (chunk)
+				mHead = getNext(chunk);
+			return chunk;
+		}
+
+		void push(unsigned char* chunk) {
+			setNext(chunk, mHead);
+			mHead = chunk;
+		}
+
+		// push an already linked run of chunks in one go
+		void pushChain(unsigned char* first, unsigned char* last) {
+			setNext(last, mHead);
+			mHead = first;
+		}
+
+		static unsigned char* getNext(unsigned char* chunk) {
+			return reinterpret_cast<unsigned char**>(chunk)[0];
+		}
+
+		static void setNext(unsigned char* chunk, unsigned char* next) {
+			reinterpret_cast<unsigned char**>(chunk)[0] = next;
+		}
+
+	private:
+
+		unsigned char* mHead{ nullptr };
+	};
+
+	class lock_free_list
+	{
+	public:
+
+		typedef std::mutex mutex_type;
+
+		constexpr static const bool IS_CONCURRENT = true;
+
+		// swaps before the tag comes back to the same value
+		constexpr static const unsigned int TAG_BITS = MEM_HAS_DOUBLE_WIDTH_CAS ? 64 : sizeof(void*) == 8 ? 16 : 32;
+
+		lock_free_list() : mHead(0) {}
+
+		bool empty() const { return front() == nullptr; }
+		unsigned char* front() const { return unpack(loadHead()); }
+		void clear() { takeAll(); }
+
+		// detach the whole list, it is left empty.  A pop that read the old head fails its swap because
+		// the tag moves on, so the detached chunks belong to the caller alone
+		unsigned char* takeAll() {
+			head_word head = loadHead();
+			while (!swapHead(head, pack(nullptr, head))) {}
+			return unpack(head);
+		}
+
+		unsigned char* pop() {
+			head_word head = loadHead();
+			for (;;) {
+				unsigned char* chunk = unpack(head);
+				if (!chunk)
+					return nullptr;
+
+				// the chunk may already belong to someone else by the time we read its link, in which
+				// case the tag has moved on and the swap below fails
+				unsigned char* next = getNext(chunk);
+				if (swapHead(head, pack(next, head)))
+					return chunk;
+			}
+		}
+
+		void push(unsigned char* chunk) {
+			pushChain(chunk, chunk);
+		}
+
+		// push an already linked run of chunks in one go, the swap publishes the links within it
+		void pushChain(unsigned char* first, unsigned char* last) {
+			head_word head = loadHead();
+			do {
+				setNext(last, unpack(head));
+			} while (!swapHead(head, pack(first, head)));
+		}
+
+		static unsigned char* getNext(unsigned char* chunk) {
+			return reinterpret_cast<std::atomic<unsigned char*>*>(chunk)->load(std::memory_order_relaxed);
+		}
+
+		static void setNext(unsigned char* chunk, unsigned char* next) {
+			reinterpret_cast<std::atomic<unsigned char*>*>(chunk)->store(next, std::memory_order_relaxed);
+		}
+
+	private:
+
+#if MEM_HAS_DOUBLE_WIDTH_CAS
+		// the pointer in the low half, the tag in the high half
+		typedef unsigned __int128 head_word;
+		constexpr static const unsigned int POINTER_BITS = 64;
+
+		// the two halves are read one at a time, tag first.  Tags only grow, so when the swap finds the
+		// tag that was read the pointer read after it is still the one next to it, and a torn read
+		// just fails the swap
+		head_word loadHead() const {
+			const uint64_t* halves = reinterpret_cast<const uint64_t*>(&mHead);
+			uint64_t tag = __atomic_load_n(&halves[1], __ATOMIC_ACQUIRE);
+			uint64_t chunk = __atomic_load_n(&halves[0], __ATOMIC_ACQUIRE);
+			return (head_word(tag) << POINTER_BITS) | chunk;
+		}
+
+		// cmpxchg16b, a full barrier.  On failure head is updated to what the list holds
+		bool swapHead(head_word& head, head_word desired) {
+			head_word previous = __sync_val_compare_and_swap(&mHead, head, desired);
+			bool swapped = previous == head;
+			head = previous;
+			return swapped;
+		}
+
+		alignas(16) head_word mHead;
+#else
+		// user space pointers fit in the low 48 bits on 64-bit targets, the rest is the tag
+		typedef uint64_t head_word;
+		constexpr static const unsigned int POINTER_BITS = sizeof(void*) == 8 ? 48 : 32;
+
+		head_word loadHead() const { return mHead.load(std::memory_order_acquire); }
+
+		// acquires the chunk a pop takes and releases the links a push publishes.  On failure head is
+		// updated to what the list holds
+		bool swapHead(head_word& head, head_word desired) {
+			return mHead.compare_exchange_weak(head, desired, std::memory_order_acq_rel, std::memory_order_acquire);
+		}
+
+		std::atomic<head_word> mHead;
+#endif
+
+		constexpr static const head_word POINTER_MASK = (head_word(1) << POINTER_BITS) - 1;
+
+		static unsigned char* unpack(head_word head) {
+			return reinterpret_cast<unsigned char*>(static_cast<uintptr_t>(head & POINTER_MASK));
+		}
+
+		// the new head gets the previous head's tag plus one
+		static head_word pack(unsigned char* chunk, head_word previous) {
+			head_word tag = (previous >> POINTER_BITS) + 1;
+			head_word head = (static_cast<head_word>(reinterpret_cast<uintptr_t>(chunk)) & POINTER_MASK) | (tag << POINTER_BITS);
+			assert(unpack(head) == chunk && "the chunk's address doesn't fit in the bits the head keeps for it");
+			return head;
+		}
+
+		static_assert(sizeof(std::atomic<unsigned char*>) == sizeof(unsigned char*), "free list links must be plain pointers");
+	};
+}
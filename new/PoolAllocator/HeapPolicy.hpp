@@ -7,6 +7,7 @@
 //
 
 #pragma once
+#include <type_traits>
 #include "AllocatorTraits.hpp"
 
 template<typename T>
@@ -15,6 +16,8 @@ class heap_policy
 public:
 	
 	ALLOCATOR_TRAITS(T)
+
+	typedef std::true_type is_always_equal;
 	
 	template<typename U>
 	struct rebind
@@ -27,17 +30,17 @@ public:
 	
 	// Copy Constructor
 	template<typename U>
-	heap_policy(heap_policy<U> const& other){}
+	heap_policy(heap_policy<U> const&){}
 	
 	// Allocate memory
-	pointer allocate(size_type count, const_pointer hint = 0)
+	pointer allocate(size_type count, const_pointer = 0)
 	{
 		if(count > max_size()){throw std::bad_alloc();}
 		return static_cast<pointer>(::operator new(count * sizeof(type), ::std::nothrow));
 	}
 	
 	// Delete memory
-	void deallocate(pointer ptr, size_type count )
+	void deallocate(pointer ptr, size_type )
 	{
 		::operator delete(ptr);
 	}
@@ -0,0 +1,239 @@
+//
+//  HeapProfiler.hpp
+//  PoolAllocator
+//
+//  Copyright (c) 2017 Mike Allison. All rights reserved.
+//
+
+#pragma once
+
+//--------------------------------------------------------------------------------------------------
+// A sampling heap profiler for the pool policies, cheap enough to leave running in production.
+//
+// Every thread counts down the bytes it allocates and takes a sample, with its call stack, when the
+// count runs out.  The distance between samples is drawn from an exponential distribution with a
+// mean of the sampling interval, so on average one sample is taken every interval bytes and large
+// objects are more likely to be sampled than small ones, without any bias towards allocation
+// patterns that repeat.  The fast path of an allocation is a thread local subtraction.
+//
+// Frees check a small table of counters hashed by address and only look the pointer up in the
+// sampled set when its counter is set, so freeing an object that wasn't sampled is one relaxed load.
+//
+// writeProfile() exports the legacy gperftools heap profile that pprof reads: the live sampled
+// objects and all sampled allocations so far per stack, tagged heap_v2 with the interval so pprof
+// scales the samples back up to estimated totals, followed by the memory map for symbolization:
+//
+//   pprof -sample_index=inuse_space ./binary heap.prof
+//   pprof -sample_index=alloc_space ./binary heap.prof
+//
+// Threads notice start() and stop() the next time their countdown runs out, stopped threads check
+// back every DISABLED_INTERVAL bytes.
+//--------------------------------------------------------------------------------------------------
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#if __has_include(<execinfo.h>)
+#include <execinfo.h>
+#define MEM_HAS_BACKTRACE 1
+#else
+#define MEM_HAS_BACKTRACE 0
+#endif
+
+namespace mem {
+
+	class HeapProfiler
+	{
+	public:
+
+		constexpr static const size_t DEFAULT_INTERVAL = 512 * 1024;
+		constexpr static const int64_t DISABLED_INTERVAL = 1024 * 1024;
+		constexpr static const int MAX_FRAMES = 64;
+
+		// never destroyed, pools free objects during static destruction
+		static HeapProfiler& get() {
+			static HeapProfiler* sInstance = new HeapProfiler;
+			return *sInstance;
+		}
+
+		// start sampling on average every interval bytes, forgetting any earlier samples
+		void start(size_t interval = DEFAULT_INTERVAL) {
+#if MEM_HAS_BACKTRACE
+			// the first backtrace() loads the unwinder, which allocates
+			void* frames[1];
+			backtrace(frames, 1);
+#endif
+			std::lock_guard<std::mutex> lock(mMutex);
+			mStacks.clear();
+			mStackIndex.clear();
+			mLive.clear();
+			for (auto& count : sFilter)
+				count.store(0, std::memory_order_relaxed);
+			mInterval.store(interval ? interval : 1, std::memory_order_relaxed);
+			mEnabled.store(true, std::memory_order_release);
+		}
+
+		// stop taking samples, the ones taken so far stay until the next start()
+		void stop() { mEnabled.store(false, std::memory_order_release); }
+
+		bool isEnabled() const { return mEnabled.load(std::memory_order_relaxed); }
+
+		size_t getInterval() const { return mInterval.load(std::memory_order_relaxed); }
+
+		// called by a policy with every allocation
+		static void recordAlloc(const void* ptr, size_t bytes) {
+			if ((tBytesUntilSample -= (int64_t)bytes) < 0)
+				get().sample(ptr, bytes);
+		}
+
+		// called by a policy before every deallocation
+		static void recordFree(const void* ptr) {
+			if (ptr && sFilter[filterIndex(ptr)].load(std::memory_order_relaxed))
+				get().forget(ptr);
+		}
+
+		// the profile in the legacy heap profile format pprof reads
+		std::string getProfile() {
+			std::lock_guard<std::mutex> lock(mMutex);
+			uint64_t totals[4] = { 0, 0, 0, 0 };
+			for (const Stack& stack : mStacks) {
+				totals[0] += stack.liveCount;
+				totals[1] += stack.liveBytes;
+				totals[2] += stack.allocCount;
+				totals[3] += stack.allocBytes;
+			}
+
+			std::ostringstream str;
+			str << "heap profile: " << totals[0] << ": " << totals[1] << " [" << totals[2] << ": " << totals[3]
+				<< "] @ heap_v2/" << getInterval() << "\n";
+			for (const Stack& stack : mStacks) {
+				str << stack.liveCount << ": " << stack.liveBytes << " [" << stack.allocCount << ": " << stack.allocBytes << "] @";
+				for (uintptr_t frame : stack.frames)
+					str << " 0x" << std::hex << frame << std::dec;
+				str << "\n";
+			}
+
+			str << "\nMAPPED_LIBRARIES:\n";
+			std::ifstream maps("/proc/self/maps");
+			str << maps.rdbuf();
+			return str.str();
+		}
+
+		bool writeProfile(const std::string& path) {
+			std::string profile = getProfile();
+			std::ofstream file(path, std::ios::binary);
+			file << profile;
+			return (bool)file;
+		}
+
+	private:
+
+		constexpr static const size_t FILTER_SIZE = 1 << 16;
+
+		struct Stack {
+			std::vector<uintptr_t> frames;
+			uint64_t allocCount;
+			uint64_t allocBytes;
+			uint64_t liveCount;
+			uint64_t liveBytes;
+		};
+
+		struct Sample {
+			size_t stack;
+			size_t bytes;
+		};
+
+		HeapProfiler() = default;
+
+		static size_t filterIndex(const void* ptr) {
+			return (size_t)(((uint64_t)(uintptr_t)ptr * 0x9E3779B97F4A7C15ull) >> 48);
+		}
+
+		// bytes to the next sample, exponentially distributed around the interval
+		int64_t nextSample() {
+			uint64_t& state = tRandom;
+			if (!state)
+				state = (uint64_t)(uintptr_t)&state ^ 0x2545F4914F6CDD1Dull;
+			state ^= state << 13;
+			state ^= state >> 7;
+			state ^= state << 17;
+			double uniform = ((state >> 11) + 0.5) / 9007199254740992.0;
+			return (int64_t)(-std::log(uniform) * getInterval()) + 1;
+		}
+
+		void sample(const void* ptr, size_t bytes) {
+			if (!isEnabled()) {
+				tArmed = false;
+				tBytesUntilSample = DISABLED_INTERVAL;
+				return;
+			}
+			// a countdown that ran out while the profiler was stopped only starts the first real one
+			bool armed = tArmed;
+			tArmed = true;
+			tBytesUntilSample = nextSample();
+			if (!armed || !ptr)
+				return;
+
+			std::vector<uintptr_t> frames;
+#if MEM_HAS_BACKTRACE
+			void* buffer[MAX_FRAMES];
+			int depth = backtrace(buffer, MAX_FRAMES);
+			// leave out sample() itself
+			for (int i = 1; i < depth; ++i)
+				frames.push_back((uintptr_t)buffer[i]);
+#endif
+
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (!isEnabled())
+				return;
+			std::string key((const char*)frames.data(), frames.size() * sizeof(uintptr_t));
+			auto it = mStackIndex.find(key);
+			if (it == mStackIndex.end()) {
+				it = mStackIndex.emplace(key, mStacks.size()).first;
+				mStacks.push_back(Stack{ frames, 0, 0, 0, 0 });
+			}
+			Stack& stack = mStacks[it->second];
+			++stack.allocCount;
+			stack.allocBytes += bytes;
+			++stack.liveCount;
+			stack.liveBytes += bytes;
+			if (mLive.emplace(ptr, Sample{ it->second, bytes }).second)
+				sFilter[filterIndex(ptr)].fetch_add(1, std::memory_order_relaxed);
+		}
+
+		void forget(const void* ptr) {
+			std::lock_guard<std::mutex> lock(mMutex);
+			auto it = mLive.find(ptr);
+			if (it == mLive.end())
+				return;
+			Stack& stack = mStacks[it->second.stack];
+			--stack.liveCount;
+			stack.liveBytes -= it->second.bytes;
+			sFilter[filterIndex(ptr)].fetch_sub(1, std::memory_order_relaxed);
+			mLive.erase(it);
+		}
+
+		std::mutex mMutex;
+		std::atomic<bool> mEnabled{ false };
+		std::atomic<size_t> mInterval{ DEFAULT_INTERVAL };
+		std::vector<Stack> mStacks;
+		std::unordered_map<std::string, size_t> mStackIndex;  // frames -> index into mStacks
+		std::unordered_map<const void*, Sample> mLive;
+
+		// how many live samples hash to each slot
+		static inline std::atomic<uint16_t> sFilter[FILTER_SIZE];
+
+		static inline thread_local int64_t tBytesUntilSample = 0;
+		static inline thread_local bool tArmed = false;  // counting down a drawn interval
+		static inline thread_local uint64_t tRandom = 0;
+	};
+
+}
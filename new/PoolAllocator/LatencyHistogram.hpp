@@ -0,0 +1,178 @@
+//
+//  LatencyHistogram.hpp
+//  PoolAllocator
+//
+//  Copyright (c) 2017 Mike Allison. All rights reserved.
+//
+
+#pragma once
+
+//--------------------------------------------------------------------------------------------------
+// Latency histograms for pool operations, in the style of HdrHistogram: every power of two is split
+// into SUB_BUCKETS linear buckets, so any value is recorded to within 1/SUB_BUCKETS (about 6%) of
+// itself from a few cycles up to minutes, in a fixed few KB.
+//
+// Values are raw timestamp counter ticks (rdtsc on x86, cntvct_el0 on ARM64, nanoseconds from
+// steady_clock elsewhere), which cost a handful of cycles to read.  They are turned into
+// nanoseconds only when reported, against a one-off calibration of the counter.
+//
+// Buckets are relaxed atomics, so a histogram can be shared by every thread using a lock-free pool.
+// Histograms are meant to be switched on while measuring, see MemoryPool::enableLatencyHistograms().
+//--------------------------------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <thread>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#endif
+
+namespace mem {
+
+	inline uint64_t read_ticks() {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+		return __rdtsc();
+#elif defined(__aarch64__)
+		uint64_t ticks;
+		asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+		return ticks;
+#else
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+
+	// measured against steady_clock the first time it is asked for, which takes about 20ms
+	inline double ticks_per_nanosecond() {
+		static const double sRatio = [] {
+			auto clockStart = std::chrono::steady_clock::now();
+			uint64_t tickStart = read_ticks();
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			uint64_t ticks = read_ticks() - tickStart;
+			double nanoseconds = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - clockStart).count();
+			return ticks && nanoseconds > 0 ? ticks / nanoseconds : 1.0;
+		}();
+		return sRatio;
+	}
+
+	class LatencyHistogram
+	{
+	public:
+
+		constexpr static const unsigned int SUB_BUCKET_BITS = 4;
+		constexpr static const unsigned int SUB_BUCKETS = 1u << SUB_BUCKET_BITS;
+		constexpr static const unsigned int MAX_BITS = 48;  // anything longer lands in the last bucket
+		constexpr static const unsigned int NUM_BUCKETS = (MAX_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+		LatencyHistogram() { clear(); }
+
+		void record(uint64_t ticks) {
+			mCounts[bucketOf(ticks)].fetch_add(1, std::memory_order_relaxed);
+			uint64_t max = mMax.load(std::memory_order_relaxed);
+			while (ticks > max && !mMax.compare_exchange_weak(max, ticks, std::memory_order_relaxed)) {}
+		}
+
+		void clear() {
+			for (auto& count : mCounts)
+				count.store(0, std::memory_order_relaxed);
+			mMax.store(0, std::memory_order_relaxed);
+		}
+
+		uint64_t getCount() const {
+			uint64_t total = 0;
+			for (auto& count : mCounts)
+				total += count.load(std::memory_order_relaxed);
+			return total;
+		}
+
+		uint64_t getMax() const { return mMax.load(std::memory_order_relaxed); }
+
+		// the smallest recorded value at least fraction of all values are at or below, in ticks.  The
+		// top of its bucket, so it never understates, and the max for the last bucket, which takes
+		// everything too long for the others
+		uint64_t percentile(double fraction) const {
+			uint64_t total = getCount();
+			if (!total)
+				return 0;
+			uint64_t rank = (uint64_t)(fraction * total + 0.5);
+			rank = rank < 1 ? 1 : rank > total ? total : rank;
+			uint64_t seen = 0;
+			for (unsigned int i = 0; i < NUM_BUCKETS; ++i) {
+				seen += mCounts[i].load(std::memory_order_relaxed);
+				if (seen >= rank)
+					return i == NUM_BUCKETS - 1 ? getMax() : std::min(bucketTop(i), getMax());
+			}
+			return getMax();
+		}
+
+		// count p50 p99 p99.9 max on one line, in nanoseconds
+		std::string report(const char* name) const {
+			double ratio = ticks_per_nanosecond();
+			std::ostringstream str;
+			str << std::left << std::setw(6) << name << std::right
+				<< " count " << std::setw(10) << getCount() << std::fixed << std::setprecision(0)
+				<< "  p50 " << std::setw(8) << percentile(0.5) / ratio << " ns"
+				<< "  p99 " << std::setw(8) << percentile(0.99) / ratio << " ns"
+				<< "  p99.9 " << std::setw(8) << percentile(0.999) / ratio << " ns"
+				<< "  max " << std::setw(10) << getMax() / ratio << " ns\n";
+			return str.str();
+		}
+
+	private:
+
+		static unsigned int highestBit(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+			return 63 - __builtin_clzll(value);
+#else
+			unsigned int bit = 0;
+			while (value >>= 1)
+				++bit;
+			return bit;
+#endif
+		}
+
+		// values below SUB_BUCKETS get a bucket each, after that every power of two gets SUB_BUCKETS
+		static unsigned int bucketOf(uint64_t value) {
+			if (value < SUB_BUCKETS)
+				return (unsigned int)value;
+			unsigned int shift = highestBit(value) - SUB_BUCKET_BITS;
+			unsigned int bucket = (shift + 1) * SUB_BUCKETS + (unsigned int)((value >> shift) & (SUB_BUCKETS - 1));
+			return bucket < NUM_BUCKETS ? bucket : NUM_BUCKETS - 1;
+		}
+
+		static uint64_t bucketTop(unsigned int bucket) {
+			if (bucket < SUB_BUCKETS)
+				return bucket;
+			unsigned int shift = bucket / SUB_BUCKETS - 1;
+			return ((uint64_t)(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift) + ((uint64_t(1) << shift) - 1);
+		}
+
+		std::atomic<uint64_t> mCounts[NUM_BUCKETS];
+		std::atomic<uint64_t> mMax;
+	};
+
+	// the histograms a pool keeps
+	struct PoolLatency
+	{
+		LatencyHistogram alloc;  // every alloc(), grows included
+		LatencyHistogram free;
+		LatencyHistogram grow;  // just the part of an alloc() spent getting a new block
+
+		void clear() {
+			alloc.clear();
+			free.clear();
+			grow.clear();
+		}
+
+		std::string report() const {
+			return alloc.report("alloc") + free.report("free") + grow.report("grow");
+		}
+	};
+
+}
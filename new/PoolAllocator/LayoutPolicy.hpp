@@ -0,0 +1,60 @@
+//
+//  LayoutPolicy.hpp
+//  PoolAllocator
+//
+//  Copyright (c) 2017 Mike Allison. All rights reserved.
+//
+
+#pragma once
+
+//--------------------------------------------------------------------------------------------------
+// Chunk layout policies for mem::MemoryPool.  Either way the free list link sits in the first
+// pointer-sized bytes of a free chunk, what differs is whether it gets bytes of its own.
+//
+//  chunk_header_layout: every chunk carries a pointer-sized header in front of the user data that
+//                       holds the link, allocated or not.  A chunk is object_size + 8 bytes.
+//
+//  intrusive_layout:    the link is stored inside the free slot itself and is overwritten by the
+//                       object once the slot is handed out.  A chunk is just the object size rounded
+//                       up to hold (and align) one pointer, so small objects pack much more densely.
+//
+// Chunk sizes are rounded up to the pool's alignment and blocks start on that alignment, so every
+// chunk handed out is aligned for the object, including over-aligned SIMD types and cache lines.
+//--------------------------------------------------------------------------------------------------
+
+#include <stddef.h>
+
+namespace mem {
+
+	// round size up to a multiple of alignment, which must be a power of two
+	constexpr size_t align_up(size_t size, size_t alignment) {
+		return (size + alignment - 1) & ~(alignment - 1);
+	}
+
+	// chunks are always at least aligned for the free list link
+	constexpr size_t chunk_alignment(size_t object_alignment) {
+		return object_alignment < alignof(unsigned char*) ? alignof(unsigned char*) : object_alignment;
+	}
+
+	struct chunk_header_layout
+	{
+		template<size_t object_size, size_t object_alignment>
+		struct chunk
+		{
+			// the header is padded so the data that follows it stays aligned
+			constexpr static const size_t HEADER_SIZE = align_up(sizeof(unsigned char*), chunk_alignment(object_alignment));
+			constexpr static const size_t SIZE = align_up(HEADER_SIZE + object_size, chunk_alignment(object_alignment));
+		};
+	};
+
+	struct intrusive_layout
+	{
+		template<size_t object_size, size_t object_alignment>
+		struct chunk
+		{
+			constexpr static const size_t HEADER_SIZE = 0;
+			constexpr static const size_t SIZE = align_up(object_size < sizeof(unsigned char*) ? sizeof(unsigned char*) : object_size, chunk_alignment(object_alignment));
+		};
+	};
+
+}
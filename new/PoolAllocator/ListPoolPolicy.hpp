@@ -9,78 +9,157 @@
 #pragma once
 #include <exception>
 #include "MemoryPool.hpp"
+#include "ThreadCache.hpp"
 #include "AllocatorTraits.hpp"
 #include "Allocator.hpp"
+#include "HeapProfiler.hpp"
 #include <memory>
 #include <iostream>
+#include <new>
+#include <type_traits>
+#include <utility>
 
-template<typename T>
+// alignment raises the alignment of every object above alignof(T), e.g. mem::CACHE_LINE_SIZE keeps
+// hot objects from sharing or straddling cache lines.  It carries over when containers rebind.
+//
+// ProviderT is where the pool's blocks come from, see BlockProvider.hpp.  Big node containers do
+// well on mem::huge_page_provider or mem::transparent_huge_page_provider.
+//
+// Arrays of up to MAX_RUN_BYTES are served as contiguous runs of slots.  The object count is rounded
+// up to a power of two and every run length has a pool of its own, whose chunks hold that many
+// objects back to back, so vectors, deque maps and hash table buckets can share the allocator of
+// the nodes.  Bigger arrays go to operator new.
+//
+// Allocations are sampled by the HeapProfiler while it is running.
+template<typename T, size_t alignment = 0, typename ProviderT = mem::malloc_provider>
 class list_pool_policy
 {
 public:
 		
 	ALLOCATOR_TRAITS(T)
+
+	// every allocator of a type shares the same pools
+	typedef std::true_type is_always_equal;
+
+	constexpr static const size_t ALIGNMENT = alignof(T) > alignment ? alignof(T) : alignment;
+
+	// every thread allocates through its own magazines in front of the shared pool, and the free list
+	// link lives inside free slots so a chunk is no bigger than the object
+	typedef mem::ThreadCache<mem::MemoryPool<sizeof(T), ALIGNMENT, mem::basic_free_list, mem::intrusive_layout, ProviderT>> pool_type;
+
+	constexpr static const size_t MAX_RUN_BYTES = 1024;
+
+	// run pool i holds runs of 2 << i objects, none when T is too big for a run of two
+	constexpr static const size_t NUM_RUN_POOLS = [] {
+		size_t pools = 0;
+		while (((size_t)2 << pools) * sizeof(T) <= MAX_RUN_BYTES)
+			++pools;
+		return pools;
+	}();
+
+	// the longest run that is pooled
+	constexpr static const size_t MAX_RUN = NUM_RUN_POOLS ? (size_t)1 << NUM_RUN_POOLS : 1;
+
+	// the pool serving runs of objects, two or more
+	template<size_t objects>
+	using run_pool_type = mem::ThreadCache<mem::MemoryPool<sizeof(T) * objects, ALIGNMENT, mem::basic_free_list, mem::intrusive_layout, ProviderT>>;
 	
 	template<typename U>
 	struct rebind
 	{
-		typedef list_pool_policy<U> other;
+		typedef list_pool_policy<U, alignment, ProviderT> other;
 	};
 	
 	// Default Constructor
 	list_pool_policy(){
-		mem::MemoryPool<sizeof(T)>::get();
+		pool_type::getPool();
 	}
 	
 	// Copy Constructor
 	template<typename U>
-	list_pool_policy(list_pool_policy<U> const& other){
-		mem::MemoryPool<sizeof(T)>::get();
+	list_pool_policy(list_pool_policy<U, alignment, ProviderT> const&){
+		pool_type::getPool();
 	}
 	
 	// Allocate memory
-	pointer allocate(size_type count, const_pointer hint = 0)
+	pointer allocate(size_type count, const_pointer = 0)
 	{
-
+		pointer ptr;
 		if (count == 1)
-			return reinterpret_cast<pointer>(mem::MemoryPool<sizeof(T)>::get()->alloc());
-		else
-		{
-			throw std::runtime_error("pool can only do one at a time");
+			ptr = reinterpret_cast<pointer>(pool_type::alloc());
+		else if (count <= MAX_RUN)
+			ptr = reinterpret_cast<pointer>(allocRun(runIndex(count), RunIndices()));
+		else {
+			if (count > max_size()) { throw std::bad_alloc(); }
+			if (ALIGNMENT > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+				ptr = static_cast<pointer>(::operator new(count * sizeof(T), std::align_val_t(ALIGNMENT)));
+			else
+				ptr = static_cast<pointer>(::operator new(count * sizeof(T)));
 		}
+
+		mem::HeapProfiler::recordAlloc(ptr, count * sizeof(T));
+		return ptr;
 	}
 	
 	// Delete memory
 	void deallocate(pointer ptr, size_type count )
 	{
-		if (count == 1) 
-			mem::MemoryPool<sizeof(T)>::get()->free(ptr);
+		mem::HeapProfiler::recordFree(ptr);
+		if (count == 1)
+			pool_type::free(ptr);
+		else if (count <= MAX_RUN)
+			freeRun(runIndex(count), ptr, RunIndices());
+		else if (ALIGNMENT > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+			::operator delete(ptr, std::align_val_t(ALIGNMENT));
 		else
-		{
-			throw std::runtime_error("pool can only do one at a time");
-		}
+			::operator delete(ptr);
 	}
 	
 	// Max number of objects that can be allocated in one call
 	size_type max_size(void) const { return max_allocations<T>::value; }
+
+private:
+
+	typedef std::make_index_sequence<NUM_RUN_POOLS> RunIndices;
+
+	// the pool for a run of count objects
+	static size_t runIndex(size_type count) {
+		size_t index = 0;
+		while (((size_t)2 << index) < count)
+			++index;
+		return index;
+	}
+
+	template<size_t... indices>
+	static void* allocRun(size_t index, std::index_sequence<indices...>) {
+		static void* (*const sAllocs[])() = { &run_pool_type<(size_t)2 << indices>::alloc..., nullptr };
+		return sAllocs[index]();
+	}
+
+	template<size_t... indices>
+	static void freeRun(size_t index, void* ptr, std::index_sequence<indices...>) {
+		static void (*const sFrees[])(void*) = { &run_pool_type<(size_t)2 << indices>::free..., nullptr };
+		sFrees[index](ptr);
+	}
 	
 };
 
 
-// Specialize for the heap policy
-template<typename T, typename TraitsT,
-typename U, typename TraitsU>
-bool operator==(Allocator<T, list_pool_policy<T>, TraitsT> const& left,
-				Allocator<U, list_pool_policy<U>, TraitsU> const& right)
+// Specialize for the list pool policy, the pools are singletons so allocators that rebind to each
+// other always are
+template<typename T, size_t AlignT, typename ProviderT, typename TraitsT,
+typename U, size_t AlignU, typename ProviderU, typename TraitsU>
+bool operator==(Allocator<T, list_pool_policy<T, AlignT, ProviderT>, TraitsT> const&,
+				Allocator<U, list_pool_policy<U, AlignU, ProviderU>, TraitsU> const&)
 {
-	return false;
+	return AlignT == AlignU && std::is_same<ProviderT, ProviderU>::value;
 }
 
 // Also implement inequality
-template<typename T, typename TraitsT,
-typename U, typename TraitsU>
-bool operator!=(Allocator<T, list_pool_policy<T>, TraitsT> const& left,
-				Allocator<U, list_pool_policy<U>, TraitsU> const& right)
+template<typename T, size_t AlignT, typename ProviderT, typename TraitsT,
+typename U, size_t AlignU, typename ProviderU, typename TraitsU>
+bool operator!=(Allocator<T, list_pool_policy<T, AlignT, ProviderT>, TraitsT> const& left,
+				Allocator<U, list_pool_policy<U, AlignU, ProviderU>, TraitsU> const& right)
 {
 	return !(left == right);
 }
\ No newline at end of file
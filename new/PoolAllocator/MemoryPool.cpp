@@ -3,6 +3,7 @@
 #include <stdlib.h>
 
 const static size_t CHUNK_HEADER_SIZE = (sizeof(unsigned char*));
+const static size_t MAX_BLOCK_SIZE = 2 * 1024 * 1024;  // blocks double in size on every grow until they reach this many bytes
 
 MemoryPool::MemoryPool(void)
 {
@@ -22,7 +23,7 @@ bool MemoryPool::Init(unsigned int chunkSize, unsigned int numChunks)
 	
 	// fill out our size & number members
 	m_chunkSize = chunkSize;
-	m_numChunks = numChunks;
+	m_numChunks = numChunks ? numChunks : 1;
 	
 	// attempt to grow the memory array
 	if (GrowMemoryArray()) {
@@ -41,7 +42,7 @@ void MemoryPool::Destroy(void)
 		std::string str;
 		if (m_numAllocs != 0)
 			str = "***(" + std::to_string(m_numAllocs) + ") ";
-		unsigned long totalNumChunks = m_numChunks * m_memArraySize;
+		unsigned long totalNumChunks = m_totalChunks;
 		unsigned long wastedMem = (totalNumChunks - m_allocPeak) * m_chunkSize;
 		str += "Destroying memory pool: [ MemoryPool :" + std::to_string((unsigned long)m_chunkSize) + "] = " + std::to_string(m_allocPeak) + "/" + std::to_string((unsigned long)totalNumChunks) + " (" + std::to_string(wastedMem) + " bytes wasted)\n";
 
@@ -113,6 +114,8 @@ void MemoryPool::Reset(void)
 	m_chunkSize = 0;
 	m_numChunks = 0;
 	m_memArraySize = 0;
+	m_memArrayCapacity = 0;
+	m_totalChunks = 0;
 	m_toAllowResize = true;
 	m_isInitialized = false;
 #ifdef _DEBUG
@@ -128,56 +131,48 @@ bool MemoryPool::GrowMemoryArray(void)
 	std::cout << str << std::endl;
 #endif
 	
-	// allocate a new array
-	size_t allocationSize = sizeof(unsigned char*) * (m_memArraySize + 1);
-	unsigned char** ppNewMemArray = (unsigned char**)malloc(allocationSize);
-	
-	// make sure the allocation succeeded
-	if (!ppNewMemArray)
-		return false;
-	
-	// copy any existing memory pointers over
-	for (unsigned int i = 0; i < m_memArraySize; ++i)
+	// make room for the new block, doubling the array keeps this amortized constant time
+	if (m_memArraySize == m_memArrayCapacity)
 	{
-		ppNewMemArray[i] = m_ppRawMemoryArray[i];
+		unsigned int newCapacity = m_memArrayCapacity ? m_memArrayCapacity * 2 : 8;
+		unsigned char** ppNewMemArray = (unsigned char**)realloc(m_ppRawMemoryArray, sizeof(unsigned char*) * newCapacity);
+		
+		// make sure the allocation succeeded
+		if (!ppNewMemArray)
+			return false;
+		
+		m_ppRawMemoryArray = ppNewMemArray;
+		m_memArrayCapacity = newCapacity;
 	}
 	
 	// allocate a new block of memory
-	ppNewMemArray[m_memArraySize] = AllocateNewMemoryBlock();  // indexing m_memArraySize here is safe because we haven't incremented it yet to reflect the new size
+	unsigned int numChunks = m_numChunks;
+	unsigned char* pNewMem = AllocateNewMemoryBlock(numChunks);
+	if (!pNewMem)
+		return false;
 	
-	// attach the block to the end of the current memory list
-	if (m_pHead)
-	{
-		unsigned char* pCurr = m_pHead;
-		unsigned char* pNext = GetNext(m_pHead);
-		while (pNext)
-		{
-			pCurr = pNext;
-			pNext = GetNext(pNext);
-		}
-		SetNext(pCurr, ppNewMemArray[m_memArraySize]);
-	}
-	else
-	{
-		m_pHead = ppNewMemArray[m_memArraySize];
-	}
+	m_ppRawMemoryArray[m_memArraySize] = pNewMem;
+	++m_memArraySize;
+	m_totalChunks += numChunks;
 	
-	// destroy the old memory array
-	if (m_ppRawMemoryArray)
-		free(m_ppRawMemoryArray);
+	// each block is twice the size of the last one so the number of grows stays logarithmic
+	size_t maxChunks = MAX_BLOCK_SIZE / (m_chunkSize + CHUNK_HEADER_SIZE);
+	if (numChunks < maxChunks)
+		m_numChunks = (unsigned int)(numChunks * 2 < maxChunks ? numChunks * 2 : maxChunks);
 	
-	// assign the new memory array and increment the size count
-	m_ppRawMemoryArray = ppNewMemArray;
-	++m_memArraySize;
+	// attach the block to the front of the current memory list, no need to walk the list
+	unsigned char* pLast = pNewMem + (m_chunkSize + CHUNK_HEADER_SIZE) * (numChunks - 1);
+	SetNext(pLast, m_pHead);
+	m_pHead = pNewMem;
 	
 	return true;
 }
 
-unsigned char* MemoryPool::AllocateNewMemoryBlock(void)
+unsigned char* MemoryPool::AllocateNewMemoryBlock(unsigned int numChunks)
 {
 	// calculate the size of each block and the size of the actual memory allocation
 	size_t blockSize = m_chunkSize + CHUNK_HEADER_SIZE;  // chunk + linked list overhead
-	size_t trueSize = blockSize * m_numChunks;
+	size_t trueSize = blockSize * numChunks;
 	
 	// allocate the memory
 	unsigned char* pNewMem = (unsigned char*)malloc(trueSize);
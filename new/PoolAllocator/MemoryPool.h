@@ -24,9 +24,11 @@
 // Call the Alloc() function to retrieve a chunk from the memory pool.  The Alloc() function removes
 // the head of the linked list, sets the new head to the next chunk, and returns a pointer to the
 // data section of the old head.  If there aren't anymore chunks left when Alloc() is called, it
-// will allocate another block of N chunks, where N is the number of chunks you passed into Init().
-// While Alloc() is typically a very fast function, this reallocation will certainly cost you so
-// choose your initial sizes carefully.
+// will allocate another block of chunks, twice as many as the block before it until blocks reach
+// MAX_BLOCK_SIZE bytes.  The new block goes at the front of the list, so growing never walks the
+// list, and the array of blocks doubles when it fills, so growing is amortized constant time apart
+// from linking up the new block.  Still, this reallocation will certainly cost you so choose your
+// initial sizes carefully.
 //
 // Call the Free() function to release a chunk of memory back into the memory pool for reuse.  This
 // will cause the chunk to the inserted to the front of the list, ready for the next bit.
@@ -39,8 +41,10 @@ class MemoryPool
 {
 	unsigned char** m_ppRawMemoryArray;  // an array of memory blocks, each split up into chunks and connected
 	unsigned char* m_pHead;  // the front of the memory chunk linked list
-	unsigned int m_chunkSize, m_numChunks;  // the size of each chunk and number of chunks per array, respectively
+	unsigned int m_chunkSize, m_numChunks;  // the size of each chunk and number of chunks in the next array, respectively
 	unsigned int m_memArraySize;  // the number elements in the memory array
+	unsigned int m_memArrayCapacity;  // the number of elements the memory array has room for
+	unsigned long m_totalChunks;  // the number of chunks across all arrays
 	bool m_toAllowResize;  // true if we resize the memory pool when it fills up
 	bool m_isInitialized;
 	// tracking variables we only care about for debug
@@ -80,7 +84,7 @@ private:
 	
 	// internal memory allocation helpers
 	bool GrowMemoryArray(void);
-	unsigned char* AllocateNewMemoryBlock(void);
+	unsigned char* AllocateNewMemoryBlock(unsigned int numChunks);
 	
 	// internal linked list management
 	unsigned char* GetNext(unsigned char* pBlock);
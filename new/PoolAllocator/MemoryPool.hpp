@@ -1,29 +1,104 @@
 #pragma once
 
 #include <iostream>
+#include <functional>
 #include <memory>
 #include <mutex>
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <vector>
+#include "FreeListPolicy.hpp"
+#include "LayoutPolicy.hpp"
+#include "BlockProvider.hpp"
+#include "PoolStats.hpp"
+#include "PoolRegistry.hpp"
+#include "LatencyHistogram.hpp"
+#include "BlockOccupancy.hpp"
+#include "Probes.hpp"
 //#define _DEBUG
 
 namespace mem {
 
-	template<size_t object_size>
+	// ask for this alignment to give every object its own cache line(s)
+	constexpr static const size_t CACHE_LINE_SIZE = 64;
+
+	// what trim() does with a block that has no live objects left
+	enum TrimMode {
+		TRIM_RELEASE,  // free the block
+		TRIM_DECOMMIT,  // keep the block but madvise(MADV_DONTNEED) its pages away, it is reused before the pool allocates a new one
+		TRIM_DECOMMIT_LAZY  // same with MADV_FREE, the kernel only takes the pages when it needs them
+	};
+
+	// automatic trimming for single threaded pools, checked every checkInterval frees.  The pool trims
+	// once it has more than highWater free chunks per live object and keeps lowWater free chunks per
+	// live object as headroom.  The gap between the two keeps a pool that hovers around one size from
+	// freeing and regrowing the same block over and over.  Both are relative to the live count, so
+	// the pool also always keeps as many chunks as its first block had: a pool that keeps emptying
+	// out would otherwise give back its last block on every check and grow it again on the next alloc.
+	struct TrimPolicy {
+		bool enabled{ false };
+		TrimMode mode{ TRIM_RELEASE };
+		double highWater{ 1.0 };
+		double lowWater{ 0.25 };
+		size_t minReservedBytes{ 0 };  // never trim the pool below this
+		unsigned int checkInterval{ 4096 };
+	};
+
+	// object_alignment is the alignment every pointer handed out by alloc() is guaranteed to have, it
+	// must be a power of two and pools of the same size but different alignments are separate pools.
+	//
+	// FreeListT picks how the chunk list is synchronized, see FreeListPolicy.hpp.  With the default
+	// basic_free_list the pool is single threaded, with lock_free_list alloc() and free() may be called
+	// from any thread.  init(), destroy() and the destructor are never thread safe.
+	//
+	// LayoutT picks where the free list link lives, see LayoutPolicy.hpp.  The default keeps a header
+	// in front of every chunk, intrusive_layout stores the link in the free slot itself.
+	//
+	// ProviderT picks where blocks come from, see BlockProvider.hpp.  Blocks are sized to fill whole
+	// units of the provider's granularity, a huge page provider gets blocks of whole huge pages.
+	//
+	// getStats() is always available, see PoolStats.hpp.  Every pool joins the PoolRegistry.  Latency
+	// histograms for alloc, free and grow can be switched on at runtime, see LatencyHistogram.hpp.
+	// getBlockUsage() and getOccupancyMap() show how the live objects are spread over the blocks, see
+	// BlockOccupancy.hpp.  Grows, trims and exhaustion can be traced with USDT probes, see Probes.hpp.
+	//
+	// Memory goes back to the OS in trim(), which frees (or decommits) every block without a live
+	// object in it, or automatically with a TrimPolicy.  A lock-free pool only ever decommits, its
+	// blocks stay mapped until destroy().
+	template<size_t object_size, size_t object_alignment = alignof(unsigned char*), typename FreeListT = basic_free_list, typename LayoutT = chunk_header_layout, typename ProviderT = malloc_provider>
 	class MemoryPool
 	{
 
 	public:
 
-		constexpr static const size_t OBJECT_SIZE = object_size;
-		constexpr static const size_t CHUNK_HEADER_SIZE = (sizeof(unsigned char*));
+		typedef FreeListT free_list_type;
+		typedef LayoutT layout_type;
+		typedef ProviderT provider_type;
 
-		static MemoryPool<OBJECT_SIZE>* get() {
-			if (!sInstance)
-				sInstance.reset(new MemoryPool<OBJECT_SIZE>);
+		constexpr static const size_t OBJECT_SIZE = object_size;
+		constexpr static const size_t OBJECT_ALIGNMENT = object_alignment;
+		constexpr static const size_t CHUNK_HEADER_SIZE = LayoutT::template chunk<object_size, object_alignment>::HEADER_SIZE;
+		constexpr static const size_t CHUNK_SIZE = LayoutT::template chunk<object_size, object_alignment>::SIZE;  // distance from one chunk to the next
+		constexpr static const size_t CARVE_BATCH = 32;  // chunks a lock-free pool carves off a fresh block at a time
+		constexpr static const size_t BLOCK_ALIGNMENT = object_alignment > alignof(std::max_align_t) ? object_alignment : alignof(std::max_align_t);
+		constexpr static const size_t MAX_BLOCK_SIZE = 2 * 1024 * 1024;  // blocks double in size on every grow until they reach this many bytes
+
+		// called with the address and size of every block the pool allocates or frees
+		typedef std::function<void(void* memory, size_t bytes)> BlockHandlerFn;
+
+		// the singleton is created exactly once, even when several threads race to the first get()
+		static MemoryPool* get() {
+			std::call_once(sInitFlag, [] { sInstance.reset(new MemoryPool); });
 			return sInstance.get();
 		}
 
+		// a pool of its own next to the singleton, e.g. one per NUMA node.  It has no memory until init()
+		static std::unique_ptr<MemoryPool> create() { return std::unique_ptr<MemoryPool>(new MemoryPool(false)); }
+
 		// construction
 		~MemoryPool() {
+			PoolRegistry::get().remove(mRegistryId);
 			destroy();
 		}
 
@@ -34,7 +109,8 @@ namespace mem {
 				destroy();
 
 			// fill out our size & number members
-			mNumObjects = num_objects;
+			mNumObjects = num_objects ? num_objects : 1;
+			mNextBlockObjects = mNumObjects;
 
 			// attempt to grow the memory array
 			if (growMemoryArray()) {
@@ -49,208 +125,570 @@ namespace mem {
 			// dump the state of the memory pool
 #ifdef _DEBUG
 			if (mIsInitialized) {
+				PoolStats stats = getStats();
 				std::string str;
-				if (mNumAllocs != 0)
-					str = "***(" + std::to_string(mNumAllocs) + ") ";
-				unsigned long totalNumChunks = mNumObjects * mMemArraySize;
-				unsigned long wastedMem = (totalNumChunks - mAllocPeak) * mNumObjects;
-				str += "Destroying memory pool: [ MemoryPool :" + std::to_string((unsigned long)OBJECT_SIZE) + "] = " + std::to_string(mAllocPeak) + "/" + std::to_string((unsigned long)totalNumChunks) + " (" + std::to_string(wastedMem) + " bytes wasted)\n";
+				if (stats.liveObjects != 0)
+					str = "***(" + std::to_string(stats.liveObjects) + ") ";
+				unsigned long wastedMem = stats.capacity > stats.peakObjects ? (stats.capacity - stats.peakObjects) * CHUNK_SIZE : 0;
+				str += "Destroying memory pool: [ MemoryPool :" + std::to_string((unsigned long)OBJECT_SIZE) + "] = " + std::to_string(stats.peakObjects) + "/" + std::to_string((unsigned long)stats.capacity) + " (" + std::to_string(wastedMem) + " bytes wasted)\n";
 				std::cout << str << std::endl;
 			}
 #endif
 			// free all memory
 			for (unsigned int i = 0; i < mMemArraySize; ++i){
-				free(mRawMemoryArray[i]);
+				if (mOnBlockDestroyHandlerFn)
+					mOnBlockDestroyHandlerFn(mRawMemoryArray[i].mMemory, CHUNK_SIZE * mRawMemoryArray[i].mNumObjects);
+				freeMemoryBlock(mRawMemoryArray[i]);
 			}
-			free(mRawMemoryArray);
+			::free(mRawMemoryArray);
 
 			// update member variables
 			reset();
 		}
 
 		void* alloc(void) {
-			// If we're out of memory chunks, grow the pool.  This is very expensive.
+			if (!mRecordLatency.load(std::memory_order_acquire))
+				return allocChunk();
 
-			if (!mHead)
-			{
-				// if we don't allow resizes, return NULL
-				if (!mAllowResize)
-					return nullptr;
+			uint64_t start = read_ticks();
+			void* ret = allocChunk();
+			mLatency->alloc.record(read_ticks() - start);
+			return ret;
+		}
 
-				// attempt to grow the pool
-				if (!growMemoryArray())
-					return nullptr;  // couldn't allocate anymore memory
+		void  free(void* ptr) {
+			if (!mRecordLatency.load(std::memory_order_acquire)) {
+				freeChunk(ptr);
+				return;
 			}
 
-#ifdef _DEBUG
-			// update allocation reports
-			++mNumAllocs;
-			if (mNumAllocs > mNumAllocs)
-				mAllocPeak = mNumAllocs;
-#endif
+			uint64_t start = read_ticks();
+			freeChunk(ptr);
+			mLatency->free.record(read_ticks() - start);
+		}
 
-			// grab the first chunk from the list and move to the next chunks
-			unsigned char* ret = mHead;
-			mHead = getNext(mHead);
+		// start or stop recording latencies, the histograms are kept when recording stops
+		void enableLatencyHistograms(bool enable) {
+			std::lock_guard<mutex_type> lock(mGrowMutex);
+			if (enable && !mLatency)
+				mLatency.reset(new PoolLatency);
+			mRecordLatency.store(enable, std::memory_order_release);
+		}
 
-			return (ret + CHUNK_HEADER_SIZE);  // make sure we return a pointer to the data section only
+		// nullptr until the histograms were first enabled
+		PoolLatency* getLatency() { return mLatency.get(); }
+
+		std::string getLatencyReport() { return mLatency ? mLatency->report() : std::string(); }
+
+		unsigned int getObjectSize() const { return OBJECT_SIZE; }
+		unsigned int getObjectAlignment() const { return OBJECT_ALIGNMENT; }
+		bool isInitialized() const { return mIsInitialized; }
+
+		// the counters are summed up from every thread's slot.  Everything read here is atomic, so the
+		// registry can call this from another thread while a single threaded pool is in use, whose grow
+		// lock is a null_mutex.  A lock-free pool takes its peak sample under the real grow lock
+		PoolStats getStats() {
+			PoolStats stats;
+			mCounters.read(stats);
+			if (FreeListT::IS_CONCURRENT) {
+				std::lock_guard<mutex_type> lock(mGrowMutex);
+				samplePeak(stats.liveObjects);
+			}
+			stats.peakObjects = std::max(mPeakObjects.load(std::memory_order_relaxed), stats.liveObjects);
+			stats.grows = mNumGrows.load(std::memory_order_relaxed);
+			stats.numBlocks = getNumBlocks();
+			stats.capacity = getCapacity();
+			stats.reservedBytes = getReservedBytes();
+			stats.usedBytes = stats.liveObjects * OBJECT_SIZE;
+			return stats;
 		}
 
-		void  free(void* ptr) {
-			if (ptr != nullptr)  	// calling Free() on a NULL pointer is perfectly valid
-			{
-				// The pointer we get back is just to the data section of the chunk.  This gets us the full chunk.
-				unsigned char* pBlock = ((unsigned char*)ptr) - CHUNK_HEADER_SIZE;
+		// what the registry lists for this pool, safe to call from any thread, see getStats()
+		PoolInfo describe() {
+			PoolStats stats = getStats();
+			PoolInfo info;
+			info.id = mRegistryId;
+			info.kind = "MemoryPool";
+			info.typeName = type_name<MemoryPool>();
+			info.objectSize = OBJECT_SIZE;
+			info.alignment = OBJECT_ALIGNMENT;
+			info.capacity = stats.capacity;
+			info.liveObjects = stats.liveObjects;
+			info.peakObjects = stats.peakObjects;
+			info.numBlocks = stats.numBlocks;
+			info.reservedBytes = stats.reservedBytes;
+			info.usedBytes = stats.usedBytes;
+			return info;
+		}
 
-				
-				// push the chunk to the front of the list
-				setNext(pBlock, mHead);
-				mHead = pBlock;
-#ifdef _DEBUG
-				// update allocation reports
-				--mNumAllocs;
-				//GCC_ASSERT(m_numAllocs >= 0);
-#endif
-				
+		uint64_t getRegistryId() const { return mRegistryId; }
+
+		// the number of chunks across all blocks that haven't been decommitted, carved or not
+		size_t getCapacity() const { return mCommittedObjects.load(std::memory_order_relaxed); }
+
+		// the bytes the pool holds on to, chunk headers and padding included
+		size_t getReservedBytes() const { return getCapacity() * CHUNK_SIZE; }
+		unsigned int getNumBlocks() const { return mMemArraySize.load(std::memory_order_relaxed); }
+		void setAllowResize(bool allow) {
+			std::lock_guard<mutex_type> lock(mGrowMutex);
+			mAllowResize = allow;
+		}
+
+		// give back every block that has no live objects in it, keeping at least keepFreeChunks free
+		// chunks around.  Returns the number of bytes given back.
+		size_t trim(TrimMode mode = TRIM_RELEASE, size_t keepFreeChunks = 0) {
+			std::lock_guard<mutex_type> lock(mGrowMutex);
+			return trimLocked(mode, keepFreeChunks, 0);
+		}
+
+		// a lock-free pool can't keep a live count without putting an atomic on every alloc and free,
+		// so automatic trimming is only there for single threaded pools
+		void setTrimPolicy(const TrimPolicy& policy) {
+			static_assert(!FreeListT::IS_CONCURRENT, "automatic trimming needs a single threaded pool, call trim() instead");
+			mTrimPolicy = policy;
+			mFreesSinceTrimCheck = 0;
+		}
+
+		const TrimPolicy& getTrimPolicy() const { return mTrimPolicy; }
+
+		// the handlers run with the grow lock held, before any chunk of a new block is handed out and
+		// after the last one of a freed block came back.  Connect them before init() to see every block
+		void connectBlockCreationHandler(const BlockHandlerFn& fn) { mOnBlockCreateHandlerFn = fn; }
+		void connectBlockDestructionHandler(const BlockHandlerFn& fn) { mOnBlockDestroyHandlerFn = fn; }
 
+		void disconnectBlockCreationHandler() { mOnBlockCreateHandlerFn = nullptr; }
+		void disconnectBlockDestructionHandler() { mOnBlockDestroyHandlerFn = nullptr; }
+
+		// the live objects and free chunks of every block, in the order the blocks were added.  The free
+		// list is walked to get them, so this is O(chunks).  Chunks parked in a ThreadCache count as live
+		std::vector<BlockUsage> getBlockUsage() {
+			std::lock_guard<mutex_type> lock(mGrowMutex);
+			std::vector<unsigned int> order = blocksByAddress();
+			std::vector<std::vector<bool>> free(mMemArraySize);
+			for (unsigned int i = 0; i < mMemArraySize; ++i)
+				free[i].assign(mRawMemoryArray[i].mNumObjects, mRawMemoryArray[i].mDecommitted);
+
+			unsigned char* chain = mFreeList.takeAll();
+			for (unsigned char* pCurr = chain; pCurr; pCurr = FreeListT::getNext(pCurr)) {
+				unsigned int i = findBlock(order, pCurr);
+				free[i][(pCurr - mRawMemoryArray[i].mMemory) / CHUNK_SIZE] = true;
+			}
+			putBack(chain, order, nullptr);
+
+			size_t uncarved = mBumpCurrent < mBumpEnd ? (mBumpEnd - mBumpCurrent) / CHUNK_SIZE : 0;
+			unsigned int bumpBlock = uncarved ? findBlock(order, mBumpCurrent) : 0;
+			if (uncarved)
+				std::fill(free[bumpBlock].end() - uncarved, free[bumpBlock].end(), true);
+
+			std::vector<BlockUsage> usage;
+			for (unsigned int i = 0; i < mMemArraySize; ++i) {
+				const MemoryBlock& block = mRawMemoryArray[i];
+				BlockUsage entry{ block.mNumObjects, 0, uncarved && i == bumpBlock ? uncarved : 0, 0, block.mDecommitted };
+				size_t run = 0;
+				for (bool isFree : free[i]) {
+					run = isFree ? run + 1 : 0;
+					entry.liveObjects += isFree ? 0 : 1;
+					entry.longestFreeRun = std::max(entry.longestFreeRun, run);
+				}
+				usage.push_back(entry);
 			}
+			return usage;
 		}
 
-		unsigned int getObjectSize() const { return OBJECT_SIZE; }
-		bool isInitialized() const { return mIsInitialized; }
-		void setAllowResize(bool allow) { mAllowResize = allow; }
+		// the share of chunks in occupied blocks that are free, see BlockOccupancy.hpp
+		double getFragmentation() { return fragmentation_index(getBlockUsage()); }
+
+		// a text heatmap of getBlockUsage(), one character per block
+		std::string getOccupancyMap(unsigned int width = 64) { return occupancy_map(type_name<MemoryPool>(), getBlockUsage(), width); }
 
 	private:
 
-		static std::shared_ptr<MemoryPool<OBJECT_SIZE>> sInstance;
+		typedef typename FreeListT::mutex_type mutex_type;
+
+		static std::shared_ptr<MemoryPool> sInstance;
+		static std::once_flag sInitFlag;
 
-		MemoryPool() {
+		MemoryPool(bool initialize = true) {
 			reset();
-			init(1024);
+			mRegistryId = PoolRegistry::get().add([this] { return describe(); });
+			if (initialize)
+				init(1024);
 		}
 
-		unsigned char** mRawMemoryArray;  // an array of memory blocks, each split up into chunks and connected
-		unsigned char* mHead;  // the front of the memory chunk linked list
-		unsigned int mNumObjects;  // the size of each chunk and number of chunks per array, respectively
-		unsigned int mMemArraySize;  // the number elements in the memory array
+		struct MemoryBlock {
+			unsigned char* mMemory;
+			unsigned int mNumObjects;
+			bool mDecommitted;  // trimmed, the next grow reuses it
+		};
+
+		MemoryBlock* mRawMemoryArray;  // an array of memory blocks, each split up into chunks and connected
+		FreeListT mFreeList;  // the memory chunk linked list
+		mutex_type mGrowMutex;  // serializes growing, never taken on the fast path
+		unsigned int mNumObjects;  // the number of chunks in the first block
+		unsigned int mNextBlockObjects;  // the number of chunks the next block will get
+		std::atomic<unsigned int> mMemArraySize;  // the number elements in the memory array, atomic like mCommittedObjects for getStats()
+		unsigned int mMemArrayCapacity;  // the number of elements the memory array has room for
+		unsigned char* mBumpCurrent;  // the next never-used chunk in the newest block
+		unsigned char* mBumpEnd;  // the end of the newest block
+		std::atomic<size_t> mCommittedObjects;  // chunks in blocks that aren't decommitted, only changed under the grow lock
+		unsigned long mNumLive;  // objects handed out, only kept by single threaded pools
+		unsigned int mFreesSinceTrimCheck;
+		TrimPolicy mTrimPolicy;
+		PoolCounters mCounters;
+		std::atomic<unsigned long> mPeakObjects;  // exact for a single threaded pool, sampled on the slow path for a lock-free one
+		std::atomic<unsigned long> mNumGrows;
+		uint64_t mRegistryId;
+		std::atomic<bool> mRecordLatency{ false };
+		std::unique_ptr<PoolLatency> mLatency;  // outlives destroy() and init(), like the handlers
+		BlockHandlerFn mOnBlockCreateHandlerFn{ nullptr };
+		BlockHandlerFn mOnBlockDestroyHandlerFn{ nullptr };
 		bool mAllowResize;  // true if we resize the memory pool when it fills up
 		bool mIsInitialized;
 
-#ifdef _DEBUG
-		unsigned long mAllocPeak, mNumAllocs;
-#endif
+
+		void* allocChunk(void) {
+			// grab the first chunk from the list and move to the next chunks
+			unsigned char* ret = mFreeList.pop();
+
+			// If we're out of memory chunks, grow the pool.  This is very expensive.
+			if (!ret)
+			{
+				ret = growAndAlloc();
+				if (!ret) {
+					mCounters.countFailedAlloc();
+					MEM_PROBE3(pool_exhausted, this, OBJECT_SIZE, mCommittedObjects.load(std::memory_order_relaxed));
+					return nullptr;  // couldn't allocate anymore memory
+				}
+			}
+
+			// a lock-free pool has no live count to compare against here, its peak is taken on the slow path
+			mCounters.countAlloc();
+			if (!FreeListT::IS_CONCURRENT && ++mNumLive > mPeakObjects.load(std::memory_order_relaxed))
+				mPeakObjects.store(mNumLive, std::memory_order_relaxed);
+
+			return (ret + CHUNK_HEADER_SIZE);  // make sure we return a pointer to the data section only
+		}
+
+		void freeChunk(void* ptr) {
+			if (ptr != nullptr)  	// calling Free() on a NULL pointer is perfectly valid
+			{
+				// The pointer we get back is just to the data section of the chunk.  This gets us the full chunk.
+				unsigned char* pBlock = ((unsigned char*)ptr) - CHUNK_HEADER_SIZE;
+
+				// push the chunk to the front of the list
+				mFreeList.push(pBlock);
+				mCounters.countFree();
+
+				if (!FreeListT::IS_CONCURRENT) {
+					--mNumLive;
+					if (mTrimPolicy.enabled && ++mFreesSinceTrimCheck >= mTrimPolicy.checkInterval)
+						autoTrim();
+				}
+			}
+		}
 
 		// resets internal vars
 		void reset() {
 			mRawMemoryArray = nullptr;
-			mHead = nullptr;
+			mFreeList.clear();
 			mNumObjects = 0;
+			mNextBlockObjects = 0;
 			mMemArraySize = 0;
+			mMemArrayCapacity = 0;
+			mBumpCurrent = nullptr;
+			mBumpEnd = nullptr;
+			mCommittedObjects = 0;
+			mNumLive = 0;
+			mFreesSinceTrimCheck = 0;
+			mCounters.clear();
+			mPeakObjects.store(0, std::memory_order_relaxed);
+			mNumGrows.store(0, std::memory_order_relaxed);
 			mAllowResize = true;
 			mIsInitialized = false;
-#ifdef _DEBUG
-			mAllocPeak = 0;
-			mNumAllocs = 0;
-#endif
+		}
+
+		// slow path of alloc(), only one thread grows the pool at a time
+		unsigned char* growAndAlloc() {
+			std::lock_guard<mutex_type> lock(mGrowMutex);
+			if (FreeListT::IS_CONCURRENT)
+				samplePeak(mCounters.liveObjects());
+			for (;;) {
+				// another thread may have grown the pool or freed chunks while we were waiting
+				if (unsigned char* ret = mFreeList.pop())
+					return ret;
+
+				// hand out the next untouched chunk of the newest block
+				if (mBumpCurrent < mBumpEnd)
+					return carve();
+
+				// if we don't allow resizes, return NULL
+				if (!mAllowResize)
+					return nullptr;
+
+				// attempt to grow the pool
+				uint64_t start = mRecordLatency.load(std::memory_order_relaxed) ? read_ticks() : 0;
+				if (!growMemoryArray())
+					return nullptr;
+				if (start)
+					mLatency->grow.record(read_ticks() - start);
+			}
+		}
+
+		// the live count of a lock-free pool is only known by summing the counters, that happens when the
+		// pool runs dry, which is when it is at its fullest
+		void samplePeak(unsigned long liveObjects) {
+			if (liveObjects > mPeakObjects.load(std::memory_order_relaxed))
+				mPeakObjects.store(liveObjects, std::memory_order_relaxed);
 		}
 
 		// internal memory allocation helpers
 		bool growMemoryArray() {
+			// a trimmed block is reused before a new one is allocated, its pages come back as they are carved
+			for (unsigned int i = 0; i < mMemArraySize; ++i) {
+				MemoryBlock& block = mRawMemoryArray[i];
+				if (block.mDecommitted) {
+					block.mDecommitted = false;
+					mCommittedObjects += block.mNumObjects;
+					mBumpCurrent = block.mMemory;
+					mBumpEnd = block.mMemory + CHUNK_SIZE * block.mNumObjects;
+					mNumGrows.fetch_add(1, std::memory_order_relaxed);
+					MEM_PROBE4(pool_grow, this, OBJECT_SIZE, block.mNumObjects, CHUNK_SIZE * block.mNumObjects);
+					return true;
+				}
+			}
+
 #ifdef _DEBUG
 			std::string str("Growing memory pool: [" + std::to_string((unsigned long)OBJECT_SIZE) + "] = " + std::to_string((unsigned long)mMemArraySize + 1) + "\n");
 			std::cout << str << std::endl;
 #endif
 
-			// allocate a new array
-			size_t allocationSize = sizeof(unsigned char*) * (mMemArraySize + 1);
-			unsigned char** ppNewMemArray = (unsigned char**)malloc(allocationSize);
+			// make room for the new block, doubling the array keeps this amortized constant time
+			if (mMemArraySize == mMemArrayCapacity)
+			{
+				unsigned int newCapacity = mMemArrayCapacity ? mMemArrayCapacity * 2 : 8;
+				MemoryBlock* pNewMemArray = (MemoryBlock*)realloc(mRawMemoryArray, sizeof(MemoryBlock) * newCapacity);
 
-			// make sure the allocation succeeded
-			if (!ppNewMemArray)
-				return false;
+				// make sure the allocation succeeded
+				if (!pNewMemArray)
+					return false;
 
-			// copy any existing memory pointers over
-			for (unsigned int i = 0; i < mMemArraySize; ++i)
-			{
-				ppNewMemArray[i] = mRawMemoryArray[i];
+				mRawMemoryArray = pNewMemArray;
+				mMemArrayCapacity = newCapacity;
 			}
 
 			// allocate a new block of memory
-			ppNewMemArray[mMemArraySize] = allocateNewMemoryBlock();  // indexing m_memArraySize here is safe because we haven't incremented it yet to reflect the new size
+			unsigned int numObjects = blockObjects(mNextBlockObjects);
+			unsigned char* pNewMem = allocateNewMemoryBlock(numObjects);
+			if (!pNewMem)
+				return false;
 
-																	   // attach the block to the end of the current memory list
-			if (mHead)
-			{
-				unsigned char* pCurr = mHead;
-				unsigned char* pNext = getNext(mHead);
-				while (pNext)
-				{
-					pCurr = pNext;
-					pNext = getNext(pNext);
-				}
-				setNext(pCurr, ppNewMemArray[mMemArraySize]);
+			mRawMemoryArray[mMemArraySize].mMemory = pNewMem;
+			mRawMemoryArray[mMemArraySize].mNumObjects = numObjects;
+			mRawMemoryArray[mMemArraySize].mDecommitted = false;
+			++mMemArraySize;
+			mCommittedObjects += numObjects;
+			mNumGrows.fetch_add(1, std::memory_order_relaxed);
+			MEM_PROBE4(pool_grow, this, OBJECT_SIZE, numObjects, CHUNK_SIZE * numObjects);
+
+			if (mOnBlockCreateHandlerFn)
+				mOnBlockCreateHandlerFn(pNewMem, CHUNK_SIZE * numObjects);
+
+			// each block is twice the size of the last one so the number of grows stays logarithmic
+			size_t maxObjects = MAX_BLOCK_SIZE / CHUNK_SIZE;
+			if (numObjects < maxObjects)
+				mNextBlockObjects = (unsigned int)std::min<size_t>(size_t(numObjects) * 2, maxObjects);
+
+			// the block isn't linked into the list, its chunks are carved off one at a time as they are
+			// needed and only join the list once they are freed
+			mBumpCurrent = pNewMem;
+			mBumpEnd = pNewMem + CHUNK_SIZE * numObjects;
+
+			return true;
+		}
+
+		// take the next chunk off the bump pointer, called with the grow lock held
+		unsigned char* carve() {
+			unsigned char* ret = mBumpCurrent;
+
+			if (!FreeListT::IS_CONCURRENT) {
+				mBumpCurrent += CHUNK_SIZE;
+				return ret;
 			}
-			else
-			{
-				mHead = ppNewMemArray[mMemArraySize];
+
+			// other threads can't see the bump pointer, so carve a small batch for them and publish the
+			// rest of it on the list in one go
+			unsigned char* pFirst = ret + CHUNK_SIZE;
+			unsigned char* pEnd = std::min(ret + CHUNK_SIZE * CARVE_BATCH, mBumpEnd);
+			mBumpCurrent = pEnd;
+			if (pFirst < pEnd) {
+				for (unsigned char* pCurr = pFirst; pCurr + CHUNK_SIZE < pEnd; pCurr += CHUNK_SIZE)
+					FreeListT::setNext(pCurr, pCurr + CHUNK_SIZE);
+				mFreeList.pushChain(pFirst, pEnd - CHUNK_SIZE);
 			}
+			return ret;
+		}
 
-			// destroy the old memory array
-			if (mRawMemoryArray)
-				free(mRawMemoryArray);
+		// the indices of the blocks sorted by address, so a chunk can be traced back to its block
+		std::vector<unsigned int> blocksByAddress() const {
+			std::vector<unsigned int> order(mMemArraySize);
+			for (unsigned int i = 0; i < mMemArraySize; ++i)
+				order[i] = i;
+			std::sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b) {
+				return mRawMemoryArray[a].mMemory < mRawMemoryArray[b].mMemory;
+			});
+			return order;
+		}
 
-			// assign the new memory array and increment the size count
-			mRawMemoryArray = ppNewMemArray;
-			++mMemArraySize;
+		unsigned int findBlock(const std::vector<unsigned int>& order, unsigned char* chunk) const {
+			auto it = std::upper_bound(order.begin(), order.end(), chunk, [this](unsigned char* c, unsigned int i) {
+				return c < mRawMemoryArray[i].mMemory;
+			});
+			return *(it - 1);
+		}
 
-			return true;
+		// the free chunks in every block, chain is the detached free list.  The uncarved rest of the
+		// newest block counts as free
+		std::vector<size_t> countFreeChunks(const std::vector<unsigned int>& order, unsigned char* chain) const {
+			std::vector<size_t> freeCount(mMemArraySize, 0);
+			for (unsigned char* pCurr = chain; pCurr; pCurr = FreeListT::getNext(pCurr))
+				++freeCount[findBlock(order, pCurr)];
+			if (mBumpCurrent < mBumpEnd)
+				freeCount[findBlock(order, mBumpCurrent)] += (mBumpEnd - mBumpCurrent) / CHUNK_SIZE;
+			return freeCount;
 		}
 
-		unsigned char* allocateNewMemoryBlock() {
-			// calculate the size of each block and the size of the actual memory allocation
-			size_t blockSize = OBJECT_SIZE + CHUNK_HEADER_SIZE;  // chunk + linked list overhead
-			size_t trueSize = blockSize * mNumObjects;
+		// push a detached free list back in its original order, minus the chunks of trimmed blocks
+		void putBack(unsigned char* chain, const std::vector<unsigned int>& order, const std::vector<bool>* trimmed) {
+			unsigned char* pFirst = nullptr;
+			unsigned char* pLast = nullptr;
+			for (unsigned char* pCurr = chain; pCurr; ) {
+				unsigned char* pNext = FreeListT::getNext(pCurr);
+				if (!trimmed || !(*trimmed)[findBlock(order, pCurr)]) {
+					if (pLast)
+						FreeListT::setNext(pLast, pCurr);
+					else
+						pFirst = pCurr;
+					pLast = pCurr;
+				}
+				pCurr = pNext;
+			}
+			if (pFirst)
+				mFreeList.pushChain(pFirst, pLast);
+		}
 
-			// allocate the memory
-			unsigned char* pNewMem = (unsigned char*)malloc(trueSize);
-			if (!pNewMem)
-				return NULL;
+		// called with the grow lock held.  Frees arriving meanwhile go onto the emptied list and keep
+		// their blocks, allocs find the list empty and wait on the lock
+		size_t trimLocked(TrimMode mode, size_t keepFreeChunks, size_t minCapacity) {
+			// another thread may still be about to read a link out of a chunk it saw on the list, so a
+			// lock-free pool has to keep its memory mapped
+			if (FreeListT::IS_CONCURRENT && mode == TRIM_RELEASE)
+				mode = TRIM_DECOMMIT;
+
+			std::vector<unsigned int> order = blocksByAddress();
+			unsigned char* chain = mFreeList.takeAll();
+			std::vector<size_t> freeCount = countFreeChunks(order, chain);
+
+			size_t freeChunks = 0;
+			for (unsigned int i = 0; i < mMemArraySize; ++i) {
+				if (!mRawMemoryArray[i].mDecommitted)
+					freeChunks += freeCount[i];
+			}
 
-			// turn the memory into a linked list of chunks
-			unsigned char* pEnd = pNewMem + trueSize;
-			unsigned char* pCurr = pNewMem;
-			while (pCurr < pEnd)
-			{
-				// calculate the next pointer position
-				unsigned char* pNext = pCurr + blockSize;
+			// pick the empty blocks to give back, the newest (and biggest) first.  Releasing also frees
+			// the spares an earlier decommit left behind
+			std::vector<bool> trimmed(mMemArraySize, false);
+			size_t capacity = mCommittedObjects;
+			for (unsigned int i = mMemArraySize; i-- > 0; ) {
+				const MemoryBlock& block = mRawMemoryArray[i];
+				if (block.mDecommitted) {
+					trimmed[i] = mode == TRIM_RELEASE;
+					continue;
+				}
+				if (freeCount[i] != block.mNumObjects)
+					continue;
+				if (freeChunks - block.mNumObjects < keepFreeChunks || capacity - block.mNumObjects < minCapacity)
+					continue;
+				trimmed[i] = true;
+				freeChunks -= block.mNumObjects;
+				capacity -= block.mNumObjects;
+			}
 
-				// set the next & prev pointers
-				unsigned char** ppChunkHeader = (unsigned char**)pCurr;
-				ppChunkHeader[0] = (pNext < pEnd ? pNext : NULL);
+			putBack(chain, order, &trimmed);
+			if (mBumpCurrent < mBumpEnd && trimmed[findBlock(order, mBumpCurrent)]) {
+				mBumpCurrent = nullptr;
+				mBumpEnd = nullptr;
+			}
 
-				// move to the next block
-				pCurr += blockSize;
+			size_t released = 0;
+			unsigned int numKept = 0;
+			for (unsigned int i = 0; i < mMemArraySize; ++i) {
+				MemoryBlock block = mRawMemoryArray[i];
+				if (trimmed[i]) {
+					size_t bytes = CHUNK_SIZE * block.mNumObjects;
+					if (mode == TRIM_RELEASE) {
+						if (!block.mDecommitted) {
+							mCommittedObjects -= block.mNumObjects;
+							released += bytes;
+						}
+						if (mOnBlockDestroyHandlerFn)
+							mOnBlockDestroyHandlerFn(block.mMemory, bytes);
+						freeMemoryBlock(block);
+						continue;
+					}
+					mCommittedObjects -= block.mNumObjects;
+					// a block that can't be decommitted on this platform still becomes a spare
+					if (ProviderT::decommit(block.mMemory, bytes, mode == TRIM_DECOMMIT_LAZY))
+						released += bytes;
+					block.mDecommitted = true;
+				}
+				mRawMemoryArray[numKept++] = block;
 			}
+			mMemArraySize = numKept;
 
-			return pNewMem;
+			MEM_PROBE4(pool_trim, this, OBJECT_SIZE, (int)mode, released);
+			return released;
 		}
 
-		// internal linked list management
-		static unsigned char* getNext(unsigned char* pBlock) {
-			unsigned char** ppChunkHeader = (unsigned char**)pBlock;
-			return ppChunkHeader[0];
+		void autoTrim() {
+			mFreesSinceTrimCheck = 0;
+			size_t capacity = getCapacity();
+			size_t minCapacity = std::max<size_t>(mTrimPolicy.minReservedBytes / CHUNK_SIZE, blockObjects(mNumObjects));
+			size_t freeChunks = capacity - mNumLive;
+			if (freeChunks <= mTrimPolicy.highWater * mNumLive || capacity <= minCapacity)
+				return;
+			trimLocked(mTrimPolicy.mode, size_t(mTrimPolicy.lowWater * mNumLive), minCapacity);
 		}
 
-		static void setNext(unsigned char* pBlockToChange, unsigned char* pNewNext) {
-			unsigned char** ppChunkHeader = (unsigned char**)pBlockToChange;
-			ppChunkHeader[0] = pNewNext;
+		// the provider hands out whole units of its granularity, so use all of them
+		static unsigned int blockObjects(unsigned int numObjects) {
+			size_t granularity = ProviderT::granularity();
+			size_t bytes = (CHUNK_SIZE * numObjects + granularity - 1) / granularity * granularity;
+			return (unsigned int)(bytes / CHUNK_SIZE);
+		}
+
+		unsigned char* allocateNewMemoryBlock(unsigned int numObjects) {
+			// calculate the size of the actual memory allocation
+			size_t trueSize = CHUNK_SIZE * numObjects;
+
+			// allocate the memory, aligned so every chunk in it is.  None of it is written to here, pages
+			// the pool never reaches are never touched
+			return (unsigned char*)ProviderT::allocate(trueSize, BLOCK_ALIGNMENT);
 		}
 
+		static void freeMemoryBlock(const MemoryBlock& block) {
+			ProviderT::deallocate(block.mMemory, CHUNK_SIZE * block.mNumObjects, BLOCK_ALIGNMENT);
+		}
+
+		static_assert(object_alignment && !(object_alignment & (object_alignment - 1)), "alignment must be a power of two");
+
 		// don't allow copy constructor
 		MemoryPool(const MemoryPool& memPool) = delete;
 	};
 
 }
 
-template <size_t size>
-std::shared_ptr<mem::MemoryPool<size>> mem::MemoryPool<size>::sInstance;
\ No newline at end of file
+template <size_t object_size, size_t object_alignment, typename FreeListT, typename LayoutT, typename ProviderT>
+std::shared_ptr<mem::MemoryPool<object_size, object_alignment, FreeListT, LayoutT, ProviderT>> mem::MemoryPool<object_size, object_alignment, FreeListT, LayoutT, ProviderT>::sInstance;
+
+template <size_t object_size, size_t object_alignment, typename FreeListT, typename LayoutT, typename ProviderT>
+std::once_flag mem::MemoryPool<object_size, object_alignment, FreeListT, LayoutT, ProviderT>::sInitFlag;
\ No newline at end of file
@@ -0,0 +1,191 @@
+//
+//  MonotonicArena.hpp
+//  PoolAllocator
+//
+//  Copyright (c) 2017 Mike Allison. All rights reserved.
+//
+
+#pragma once
+
+//--------------------------------------------------------------------------------------------------
+// A bump allocator for memory that dies all at once: everything built while handling one request
+// or one frame.  alloc() moves a pointer through the current chunk, nothing is ever freed on its
+// own, and reset() makes every allocation since the last reset() dead in O(1) by moving back to
+// the start of the first chunk.  The chunks are kept and refilled in order, so an arena that has
+// seen its biggest frame doesn't allocate again.  release() gives the chunks back.
+//
+// Chunks start at the size given to the constructor and double up to MAX_CHUNK_SIZE, a request
+// bigger than the next chunk gets a chunk of its own size.  After a reset() a chunk too small for
+// the request at hand is skipped for the rest of that cycle.
+//
+// An arena is for one thread at a time.  It shows up in the PoolRegistry, where its objects are
+// the allocations since the last reset().  The registry may describe it from any thread, so the
+// counters it lists are published through atomics that only the owning thread writes, and a
+// snapshot taken while the arena is in use can be a few allocations behind.
+//--------------------------------------------------------------------------------------------------
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+#include "BlockProvider.hpp"
+#include "PoolRegistry.hpp"
+
+namespace mem {
+
+	template<typename ProviderT = malloc_provider>
+	class MonotonicArena
+	{
+
+	public:
+
+		typedef ProviderT provider_type;
+
+		constexpr static const size_t INITIAL_CHUNK_SIZE = 64 * 1024;
+		constexpr static const size_t MAX_CHUNK_SIZE = 2 * 1024 * 1024;  // chunks double in size until they reach this many bytes
+		constexpr static const size_t CHUNK_ALIGNMENT = alignof(std::max_align_t);
+
+		explicit MonotonicArena(size_t initialChunkSize = INITIAL_CHUNK_SIZE)
+			: mCurrent(0), mEnd(0), mChunk(0), mNumAllocs(0), mUsedBytes(0), mReservedBytes(0), mNumChunks(0), mPeakAllocs(0), mPeakBytes(0)
+		{
+			mNextChunkSize = initialChunkSize ? initialChunkSize : INITIAL_CHUNK_SIZE;
+			mRegistryId = PoolRegistry::get().add([this] { return describe(); });
+		}
+
+		~MonotonicArena() {
+			PoolRegistry::get().remove(mRegistryId);
+			release();
+		}
+
+		MonotonicArena(const MonotonicArena&) = delete;
+		MonotonicArena& operator=(const MonotonicArena&) = delete;
+
+		// bytes aligned to alignment, a power of two.  nullptr when no chunk could be allocated
+		void* alloc(size_t bytes, size_t alignment) {
+			uintptr_t ptr = (mCurrent + alignment - 1) & ~(uintptr_t)(alignment - 1);
+			if (ptr < mEnd && bytes <= mEnd - ptr) {
+				publish(mUsedBytes, mUsedBytes.load(std::memory_order_relaxed) + (ptr + bytes - mCurrent));
+				publish(mNumAllocs, mNumAllocs.load(std::memory_order_relaxed) + 1);
+				mCurrent = ptr + bytes;
+				return (void*)ptr;
+			}
+			return allocSlow(bytes, alignment);
+		}
+
+		// forget every allocation and start over at the first chunk, keeping all chunks
+		void reset() {
+			samplePeak();
+			publish(mUsedBytes, 0);
+			publish(mNumAllocs, 0);
+			mChunk = 0;
+			if (mChunks.empty()) {
+				mCurrent = mEnd = 0;
+				return;
+			}
+			mCurrent = (uintptr_t)mChunks[0].mMemory;
+			mEnd = mCurrent + mChunks[0].mSize;
+		}
+
+		// reset() and give every chunk back
+		void release() {
+			reset();
+			for (const Chunk& chunk : mChunks)
+				ProviderT::deallocate(chunk.mMemory, chunk.mSize, CHUNK_ALIGNMENT);
+			mChunks.clear();
+			mCurrent = mEnd = 0;
+			publish(mReservedBytes, 0);
+			publish(mNumChunks, 0);
+		}
+
+		// bytes handed out since the last reset(), alignment padding included
+		size_t getUsedBytes() const { return mUsedBytes.load(std::memory_order_relaxed); }
+		size_t getReservedBytes() const { return mReservedBytes.load(std::memory_order_relaxed); }
+		size_t getNumChunks() const { return mNumChunks.load(std::memory_order_relaxed); }
+		size_t getNumAllocs() const { return mNumAllocs.load(std::memory_order_relaxed); }
+
+		// the most bytes used between two resets so far, a good initial chunk size for the next arena
+		size_t getPeakBytes() {
+			samplePeak();
+			return mPeakBytes.load(std::memory_order_relaxed);
+		}
+
+		// what the registry lists for this arena, safe to call from any thread.  It only reads the
+		// published counters, the peaks are topped up with the current counts without being written
+		PoolInfo describe() const {
+			size_t numAllocs = getNumAllocs();
+			PoolInfo info;
+			info.id = mRegistryId;
+			info.kind = "MonotonicArena";
+			info.typeName = type_name<MonotonicArena>();
+			info.objectSize = 0;
+			info.alignment = CHUNK_ALIGNMENT;
+			info.capacity = 0;
+			info.liveObjects = numAllocs;
+			info.peakObjects = std::max(mPeakAllocs.load(std::memory_order_relaxed), numAllocs);
+			info.numBlocks = getNumChunks();
+			info.reservedBytes = getReservedBytes();
+			info.usedBytes = getUsedBytes();
+			return info;
+		}
+
+	private:
+
+		struct Chunk {
+			void* mMemory;
+			size_t mSize;
+		};
+
+		// the current chunk is full, move on to the next one that fits or make one
+		void* allocSlow(size_t bytes, size_t alignment) {
+			size_t needed = bytes + (alignment > CHUNK_ALIGNMENT ? alignment - CHUNK_ALIGNMENT : 0);
+			if (needed < bytes)
+				return nullptr;
+
+			size_t next = mChunks.empty() ? 0 : mChunk + 1;
+			while (next < mChunks.size() && mChunks[next].mSize < needed)
+				++next;
+
+			if (next == mChunks.size()) {
+				size_t size = std::max(mNextChunkSize, needed);
+				void* memory = ProviderT::allocate(size, CHUNK_ALIGNMENT);
+				if (!memory)
+					return nullptr;
+				mChunks.push_back(Chunk{ memory, size });
+				publish(mReservedBytes, mReservedBytes.load(std::memory_order_relaxed) + size);
+				publish(mNumChunks, mChunks.size());
+				mNextChunkSize = std::min(mNextChunkSize * 2, MAX_CHUNK_SIZE);
+			}
+
+			mChunk = next;
+			mCurrent = (uintptr_t)mChunks[next].mMemory;
+			mEnd = mCurrent + mChunks[next].mSize;
+			return alloc(bytes, alignment);
+		}
+
+		void samplePeak() {
+			publish(mPeakAllocs, std::max(mPeakAllocs.load(std::memory_order_relaxed), getNumAllocs()));
+			publish(mPeakBytes, std::max(mPeakBytes.load(std::memory_order_relaxed), getUsedBytes()));
+		}
+
+		// only the owning thread writes the counters, a plain store is enough to publish them
+		static void publish(std::atomic<size_t>& counter, size_t value) {
+			counter.store(value, std::memory_order_relaxed);
+		}
+
+		uintptr_t mCurrent;  // the next free byte in the current chunk
+		uintptr_t mEnd;  // the end of the current chunk
+		size_t mChunk;  // the chunk being filled
+		size_t mNextChunkSize;
+		std::vector<Chunk> mChunks;  // only ever touched by the owning thread
+		std::atomic<size_t> mNumAllocs;
+		std::atomic<size_t> mUsedBytes;  // alignment padding included, the unused tails of skipped chunks not
+		std::atomic<size_t> mReservedBytes;
+		std::atomic<size_t> mNumChunks;
+		std::atomic<size_t> mPeakAllocs;
+		std::atomic<size_t> mPeakBytes;
+		uint64_t mRegistryId;
+	};
+
+}
@@ -0,0 +1,104 @@
+//
+//  MonotonicArenaPolicy.hpp
+//  PoolAllocator
+//
+//  Copyright (c) 2017 Mike Allison. All rights reserved.
+//
+
+#pragma once
+
+#include <new>
+#include <type_traits>
+#include "AllocatorTraits.hpp"
+#include "Allocator.hpp"
+#include "MonotonicArena.hpp"
+#include "HeapProfiler.hpp"
+
+// Allocates from a mem::MonotonicArena and never frees, deallocate() does nothing.  For structures
+// that are thrown away together: build them on an arena, let them go out of scope and reset() the
+// arena, which takes back everything at once instead of node by node.
+//
+//   mem::MonotonicArena<> frame;
+//   {
+//       std::map<int, Node, std::less<int>, Allocator<std::pair<const int, Node>, monotonic_arena_policy<std::pair<const int, Node>>>> map(frame);
+//       ...
+//   }
+//   frame.reset();
+//
+// Like pool_set_policy it is stateful: allocators are equal when they share an arena, and the arena
+// goes along with the contents on copy assignment, move assignment and swap.  Memory a container
+// frees while it grows stays used until the reset, an arena suits containers that mostly insert.
+//
+// Allocations are sampled by the HeapProfiler while it is running.
+template<typename T, typename ArenaT = mem::MonotonicArena<>>
+class monotonic_arena_policy
+{
+public:
+
+	ALLOCATOR_TRAITS(T)
+
+	typedef ArenaT arena_type;
+
+	typedef std::true_type propagate_on_container_copy_assignment;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+	typedef std::false_type is_always_equal;
+
+	template<typename U>
+	struct rebind
+	{
+		typedef monotonic_arena_policy<U, ArenaT> other;
+	};
+
+	// Constructor
+	monotonic_arena_policy(ArenaT& arena) : mArena(&arena) {}
+
+	// Copy Constructor
+	template<typename U>
+	monotonic_arena_policy(monotonic_arena_policy<U, ArenaT> const& other) : mArena(&other.getArena()) {}
+
+	// Allocate memory
+	pointer allocate(size_type count, const_pointer = 0)
+	{
+		if (count > max_size()) { throw std::bad_alloc(); }
+		pointer ptr = static_cast<pointer>(mArena->alloc(count * sizeof(T), alignof(T)));
+		if (!ptr) { throw std::bad_alloc(); }
+
+		mem::HeapProfiler::recordAlloc(ptr, count * sizeof(T));
+		return ptr;
+	}
+
+	// Delete memory, it comes back when the arena is reset
+	void deallocate(pointer ptr, size_type)
+	{
+		mem::HeapProfiler::recordFree(ptr);
+	}
+
+	// Max number of objects that can be allocated in one call
+	size_type max_size(void) const { return max_allocations<T>::value; }
+
+	// resets the whole arena, every container on it has to be gone
+	void reset() { mArena->reset(); }
+
+	ArenaT& getArena() const { return *mArena; }
+
+private:
+
+	ArenaT* mArena;
+};
+
+// Allocators on the same arena can free each other's memory
+template<typename T, typename U, typename ArenaT, typename TraitsT, typename TraitsU>
+bool operator==(Allocator<T, monotonic_arena_policy<T, ArenaT>, TraitsT> const& left,
+				Allocator<U, monotonic_arena_policy<U, ArenaT>, TraitsU> const& right)
+{
+	return &left.getArena() == &right.getArena();
+}
+
+// Also implement inequality
+template<typename T, typename U, typename ArenaT, typename TraitsT, typename TraitsU>
+bool operator!=(Allocator<T, monotonic_arena_policy<T, ArenaT>, TraitsT> const& left,
+				Allocator<U, monotonic_arena_policy<U, ArenaT>, TraitsU> const& right)
+{
+	return !(left == right);
+}
@@ -0,0 +1,249 @@
+//
+//  NumaArenas.hpp
+//  PoolAllocator
+//
+//  Copyright (c) 2017 Mike Allison. All rights reserved.
+//
+
+#pragma once
+
+//--------------------------------------------------------------------------------------------------
+// One pool per NUMA node instead of one pool per process.  A thread allocates from the arena of
+// the node it runs on, and every block of an arena is mbind()ed to that node before any chunk in
+// it is handed out.  Placement is best effort: the bind only steers pages that fault in after it.
+// With a provider that maps fresh memory for every block, like mmap_provider, nothing in a block
+// has been touched yet, so since blocks are carved lazily every page lands on the arena's node.
+// With malloc_provider a block can be made of pages the heap recycled, and those stay wherever
+// they already are (MPOL_PREFERRED without MPOL_MF_MOVE doesn't migrate anything).
+//
+// A chunk can be freed on any node, it goes back to the arena whose block it came from.  The arenas
+// keep a sorted table of block address ranges that is rebuilt whenever a block is added or freed
+// (rare, blocks grow geometrically) and published with a single pointer swap, so free() is a
+// lock-free binary search followed by the arena's own free().
+//
+// PoolT must be a lock-free MemoryPool since every thread on a node shares its arena.  The node
+// of a thread is looked up once, on its first alloc(); pin threads that care about locality.
+//
+// On a single node machine, or anywhere but Linux, there is exactly one arena, nothing is bound
+// and free() skips the lookup.
+//--------------------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+#include "MemoryPool.hpp"
+#ifdef __linux__
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#if __has_include(<linux/mempolicy.h>)
+#include <linux/mempolicy.h>
+#define MEM_HAS_MBIND 1
+#endif
+#endif
+#ifndef MEM_HAS_MBIND
+#define MEM_HAS_MBIND 0
+#endif
+
+namespace mem {
+
+	// the highest node id plus one, 1 when there is no NUMA
+	inline unsigned int numa_node_count() {
+		unsigned int count = 1;
+#ifdef __linux__
+		if (DIR* dir = opendir("/sys/devices/system/node")) {
+			while (dirent* entry = readdir(dir)) {
+				if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9')
+					count = std::max(count, (unsigned int)atoi(entry->d_name + 4) + 1);
+			}
+			closedir(dir);
+		}
+#endif
+		return count;
+	}
+
+	// the node the calling thread is running on right now
+	inline unsigned int numa_current_node() {
+#if defined(__linux__) && defined(SYS_getcpu)
+		unsigned int cpu = 0, node = 0;
+		if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0)
+			return node;
+#endif
+		return 0;
+	}
+
+	// ask for the whole pages in [memory, memory + size) to come from node.  MPOL_PREFERRED rather
+	// than MPOL_BIND, a full node spills over instead of failing the page fault
+	inline bool numa_bind(void* memory, size_t size, unsigned int node) {
+#if MEM_HAS_MBIND
+		constexpr size_t MASK_BITS = 1024;
+		if (node >= MASK_BITS)
+			return false;
+		unsigned long mask[MASK_BITS / (8 * sizeof(unsigned long))] = {};
+		mask[node / (8 * sizeof(unsigned long))] = 1ul << (node % (8 * sizeof(unsigned long)));
+
+		uintptr_t begin = ((uintptr_t)memory + page_size() - 1) & ~(uintptr_t)(page_size() - 1);
+		uintptr_t end = ((uintptr_t)memory + size) & ~(uintptr_t)(page_size() - 1);
+		if (begin >= end)
+			return true;
+		return syscall(SYS_mbind, (void*)begin, end - begin, MPOL_PREFERRED, mask, MASK_BITS, 0) == 0;
+#else
+		return false;
+#endif
+	}
+
+	template<typename PoolT>
+	class NumaArenas
+	{
+
+	public:
+
+		typedef PoolT pool_type;
+
+		static_assert(PoolT::free_list_type::IS_CONCURRENT, "every thread on a node shares the arena, it needs a lock-free pool");
+
+		constexpr static const unsigned int INITIAL_OBJECTS = 1024;  // chunks in the first block of every arena
+
+		static void* alloc(void) {
+			Arenas* arenas = get();
+			return arenas->mPools[localArena(arenas)]->alloc();
+		}
+
+		static void free(void* ptr) {
+			if (ptr == nullptr)
+				return;
+			Arenas* arenas = get();
+			arenas->mPools[arenas->owner(ptr)]->free(ptr);
+		}
+
+		static unsigned int getNumArenas(void) { return (unsigned int)get()->mPools.size(); }
+
+		// the arena of a node, nodes beyond the last arena share arena 0
+		static PoolT* getArena(unsigned int node) {
+			Arenas* arenas = get();
+			return arenas->mPools[node < arenas->mPools.size() ? node : 0].get();
+		}
+
+		// trim every arena, see MemoryPool::trim()
+		static size_t trim(TrimMode mode = TRIM_DECOMMIT) {
+			size_t released = 0;
+			for (auto& pool : get()->mPools)
+				released += pool->trim(mode);
+			return released;
+		}
+
+	private:
+
+		struct Range {
+			uintptr_t mBegin;
+			uintptr_t mEnd;
+			unsigned int mArena;
+		};
+
+		class Arenas
+		{
+		public:
+
+			Arenas() : mTable(nullptr) {
+				unsigned int numNodes = numa_node_count();
+				mTables.emplace_back(new std::vector<Range>);
+				mTable.store(mTables.back().get(), std::memory_order_release);
+
+				for (unsigned int node = 0; node < numNodes; ++node) {
+					std::unique_ptr<PoolT> pool = PoolT::create();
+					if (numNodes > 1) {
+						pool->connectBlockCreationHandler([this, node](void* memory, size_t bytes) {
+							numa_bind(memory, bytes, node);
+							addRange(memory, bytes, node);
+						});
+						pool->connectBlockDestructionHandler([this](void* memory, size_t) {
+							removeRange(memory);
+						});
+					}
+					pool->init(INITIAL_OBJECTS);
+					mPools.push_back(std::move(pool));
+				}
+			}
+
+			~Arenas() {
+				for (auto& pool : mPools)
+					pool->disconnectBlockDestructionHandler();
+			}
+
+			unsigned int owner(void* ptr) const {
+				if (mPools.size() == 1)
+					return 0;
+				const std::vector<Range>& table = *mTable.load(std::memory_order_acquire);
+				auto it = std::upper_bound(table.begin(), table.end(), (uintptr_t)ptr, [](uintptr_t p, const Range& range) {
+					return p < range.mBegin;
+				});
+				return it == table.begin() ? 0 : (it - 1)->mArena;
+			}
+
+			std::vector<std::unique_ptr<PoolT>> mPools;
+
+		private:
+
+			// a new table is published for every change, the old ones are kept around because a free()
+			// may still be searching them
+			void addRange(void* memory, size_t bytes, unsigned int arena) {
+				std::lock_guard<std::mutex> lock(mTableMutex);
+				std::vector<Range>* table = new std::vector<Range>(*mTable.load(std::memory_order_relaxed));
+				Range range{ (uintptr_t)memory, (uintptr_t)memory + bytes, arena };
+				table->insert(std::upper_bound(table->begin(), table->end(), range, [](const Range& a, const Range& b) {
+					return a.mBegin < b.mBegin;
+				}), range);
+				publish(table);
+			}
+
+			void removeRange(void* memory) {
+				std::lock_guard<std::mutex> lock(mTableMutex);
+				std::vector<Range>* table = new std::vector<Range>(*mTable.load(std::memory_order_relaxed));
+				table->erase(std::remove_if(table->begin(), table->end(), [memory](const Range& range) {
+					return range.mBegin == (uintptr_t)memory;
+				}), table->end());
+				publish(table);
+			}
+
+			void publish(std::vector<Range>* table) {
+				mTables.emplace_back(table);
+				mTable.store(table, std::memory_order_release);
+			}
+
+			std::mutex mTableMutex;
+			std::atomic<const std::vector<Range>*> mTable;
+			std::vector<std::unique_ptr<std::vector<Range>>> mTables;
+		};
+
+		static Arenas* get(void) {
+			std::call_once(sArenasFlag, [] { sArenas.reset(new Arenas); });
+			return sArenas.get();
+		}
+
+		static unsigned int localArena(Arenas* arenas) {
+			if (tArena < 0)
+				tArena = (int)numa_current_node();
+			return (unsigned int)tArena < arenas->mPools.size() ? (unsigned int)tArena : 0;
+		}
+
+		static std::shared_ptr<Arenas> sArenas;
+		static std::once_flag sArenasFlag;
+
+		static thread_local int tArena;
+	};
+
+}
+
+template<typename PoolT>
+std::shared_ptr<typename mem::NumaArenas<PoolT>::Arenas> mem::NumaArenas<PoolT>::sArenas;
+
+template<typename PoolT>
+std::once_flag mem::NumaArenas<PoolT>::sArenasFlag;
+
+template<typename PoolT>
+thread_local int mem::NumaArenas<PoolT>::tArena = -1;
@@ -0,0 +1,110 @@
+//
+//  NumaPoolPolicy.hpp
+//  PoolAllocator
+//
+//  Copyright (c) 2017 Mike Allison. All rights reserved.
+//
+
+#pragma once
+
+#include <new>
+#include <type_traits>
+#include "AllocatorTraits.hpp"
+#include "Allocator.hpp"
+#include "MemoryPool.hpp"
+#include "NumaArenas.hpp"
+#include "HeapProfiler.hpp"
+
+// Objects come from the pool of the NUMA node the allocating thread runs on, see NumaArenas.hpp, and
+// go back to the pool they came from whichever thread frees them.  Every thread on a node shares its
+// arena, so the arenas are lock-free pools with no ThreadCache in front.  On a single node machine
+// there is one arena, a lock-free pool shared by every thread.
+//
+// alignment and ProviderT work like they do for list_pool_policy, except that blocks come from
+// anonymous mappings by default so their pages are first touched after NumaArenas binds them.
+// Arrays go to operator new.
+//
+// Allocations are sampled by the HeapProfiler while it is running.
+template<typename T, size_t alignment = 0, typename ProviderT = mem::anonymous_mmap_provider>
+class numa_pool_policy
+{
+public:
+
+	ALLOCATOR_TRAITS(T)
+
+	// every allocator of a type shares the same arenas
+	typedef std::true_type is_always_equal;
+
+	constexpr static const size_t ALIGNMENT = alignof(T) > alignment ? alignof(T) : alignment;
+
+	typedef mem::NumaArenas<mem::MemoryPool<sizeof(T), ALIGNMENT, mem::lock_free_list, mem::intrusive_layout, ProviderT>> pool_type;
+
+	template<typename U>
+	struct rebind
+	{
+		typedef numa_pool_policy<U, alignment, ProviderT> other;
+	};
+
+	// Default Constructor
+	numa_pool_policy() {
+		pool_type::getNumArenas();
+	}
+
+	// Copy Constructor
+	template<typename U>
+	numa_pool_policy(numa_pool_policy<U, alignment, ProviderT> const&) {
+		pool_type::getNumArenas();
+	}
+
+	// Allocate memory
+	pointer allocate(size_type count, const_pointer = 0)
+	{
+		pointer ptr;
+		if (count == 1)
+			ptr = static_cast<pointer>(pool_type::alloc());
+		else {
+			if (count > max_size()) { throw std::bad_alloc(); }
+			if (ALIGNMENT > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+				ptr = static_cast<pointer>(::operator new(count * sizeof(T), std::align_val_t(ALIGNMENT)));
+			else
+				ptr = static_cast<pointer>(::operator new(count * sizeof(T)));
+		}
+
+		mem::HeapProfiler::recordAlloc(ptr, count * sizeof(T));
+		return ptr;
+	}
+
+	// Delete memory
+	void deallocate(pointer ptr, size_type count)
+	{
+		mem::HeapProfiler::recordFree(ptr);
+		if (count == 1)
+			pool_type::free(ptr);
+		else if (ALIGNMENT > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+			::operator delete(ptr, std::align_val_t(ALIGNMENT));
+		else
+			::operator delete(ptr);
+	}
+
+	// Max number of objects that can be allocated in one call
+	size_type max_size(void) const { return max_allocations<T>::value; }
+};
+
+// Specialize for the NUMA pool policy, the arenas are singletons so allocators that rebind to each
+// other always are
+template<typename T, size_t AlignT, typename ProviderT, typename TraitsT,
+	typename U, size_t AlignU, typename ProviderU, typename TraitsU>
+	bool operator==(Allocator<T, numa_pool_policy<T, AlignT, ProviderT>, TraitsT> const&,
+		Allocator<U, numa_pool_policy<U, AlignU, ProviderU>, TraitsU> const&)
+{
+	return AlignT == AlignU && std::is_same<ProviderT, ProviderU>::value;
+}
+
+// Also implement inequality
+template<typename T, size_t AlignT, typename ProviderT, typename TraitsT,
+	typename U, size_t AlignU, typename ProviderU, typename TraitsU>
+	bool operator!=(Allocator<T, numa_pool_policy<T, AlignT, ProviderT>, TraitsT> const& left,
+		Allocator<U, numa_pool_policy<U, AlignU, ProviderU>, TraitsU> const& right)
+{
+	return !(left == right);
+}
@@ -26,7 +26,7 @@ public:
 	
 	// Copy Constructor
 	template<typename U>
-	basic_object_traits(basic_object_traits<U> const& other){}
+	basic_object_traits(basic_object_traits<U> const&){}
 	
 	// Address of object
 	type*       address(type&       obj) const {return &obj;}
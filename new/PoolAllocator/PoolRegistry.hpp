@@ -0,0 +1,258 @@
+//
+//  PoolRegistry.hpp
+//  PoolAllocator
+//
+//  Copyright (c) 2017 Mike Allison. All rights reserved.
+//
+
+#pragma once
+
+//--------------------------------------------------------------------------------------------------
+// Every pool in the process joins the PoolRegistry when it is constructed and leaves it when it is
+// destroyed, so a running process can list its pools and see which ones hold the memory.
+//
+// getPools() takes a snapshot: the registry is locked for the whole walk so no pool joins or
+// leaves halfway.  The pools are described on the snapshotting thread while their owners keep
+// going, so every describe() reads only atomics: the counters of a MemoryPool, the published
+// counts of an ObjectPool or a MonotonicArena.  A pool behind a ThreadCache is described under the
+// depot lock as well.  Numbers read from a pool in use can be a few operations apart.
+//
+// A snapshot can be exported as JSON or in the Prometheus text format, and written to a file (via a
+// temporary and a rename, so a scraper never reads half of one) or to a Unix socket.
+//--------------------------------------------------------------------------------------------------
+
+#include <stddef.h>
+#include <stdint.h>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <typeinfo>
+#include <vector>
+#if __has_include(<cxxabi.h>)
+#include <cxxabi.h>
+#include <stdlib.h>
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace mem {
+
+	// what a pool reports about itself
+	struct PoolInfo
+	{
+		uint64_t id;
+		std::string kind;  // MemoryPool, ObjectPool, MonotonicArena
+		std::string typeName;
+		size_t objectSize;  // the size class
+		size_t alignment;
+		size_t capacity;  // objects the pool has room for without growing
+		size_t liveObjects;
+		size_t peakObjects;
+		size_t numBlocks;
+		size_t reservedBytes;
+		size_t usedBytes;
+	};
+
+	enum ExportFormat {
+		EXPORT_JSON,
+		EXPORT_PROMETHEUS
+	};
+
+	// the readable name of T where the compiler can tell us
+	template<typename T>
+	std::string type_name() {
+		const char* name = typeid(T).name();
+#if __has_include(<cxxabi.h>)
+		int status = 0;
+		if (char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status)) {
+			std::string result(demangled);
+			::free(demangled);
+			return result;
+		}
+#endif
+		return name;
+	}
+
+	class PoolRegistry
+	{
+	public:
+
+		typedef std::function<PoolInfo()> DescribeFn;
+
+		// never destroyed, pools with static storage leave the registry during static destruction
+		static PoolRegistry& get() {
+			static PoolRegistry* sInstance = new PoolRegistry;
+			return *sInstance;
+		}
+
+		uint64_t add(const DescribeFn& describe) {
+			std::lock_guard<std::mutex> lock(mMutex);
+			mEntries.push_back(Entry{ ++mLastId, describe });
+			return mLastId;
+		}
+
+		void remove(uint64_t id) {
+			std::lock_guard<std::mutex> lock(mMutex);
+			for (auto it = mEntries.begin(); it != mEntries.end(); ++it) {
+				if (it->mId == id) {
+					mEntries.erase(it);
+					return;
+				}
+			}
+		}
+
+		// swap how a pool describes itself, e.g. to go through the lock of whatever sits in front of it
+		void setDescribe(uint64_t id, const DescribeFn& describe) {
+			std::lock_guard<std::mutex> lock(mMutex);
+			for (auto& entry : mEntries) {
+				if (entry.mId == id)
+					entry.mDescribe = describe;
+			}
+		}
+
+		std::vector<PoolInfo> getPools() {
+			std::lock_guard<std::mutex> lock(mMutex);
+			std::vector<PoolInfo> pools;
+			for (auto& entry : mEntries) {
+				pools.push_back(entry.mDescribe());
+				pools.back().id = entry.mId;
+			}
+			return pools;
+		}
+
+		std::string toJson(const std::vector<PoolInfo>& pools) const {
+			std::ostringstream str;
+			size_t totalReserved = 0;
+			str << "{\"pools\":[";
+			for (size_t i = 0; i < pools.size(); ++i) {
+				const PoolInfo& info = pools[i];
+				str << (i ? "," : "") << "{\"id\":" << info.id
+					<< ",\"kind\":\"" << escape(info.kind, false) << "\""
+					<< ",\"type\":\"" << escape(info.typeName, false) << "\""
+					<< ",\"object_size\":" << info.objectSize
+					<< ",\"alignment\":" << info.alignment
+					<< ",\"capacity\":" << info.capacity
+					<< ",\"live_objects\":" << info.liveObjects
+					<< ",\"peak_objects\":" << info.peakObjects
+					<< ",\"blocks\":" << info.numBlocks
+					<< ",\"reserved_bytes\":" << info.reservedBytes
+					<< ",\"used_bytes\":" << info.usedBytes << "}";
+				totalReserved += info.reservedBytes;
+			}
+			str << "],\"total_reserved_bytes\":" << totalReserved << "}\n";
+			return str.str();
+		}
+
+		std::string toPrometheus(const std::vector<PoolInfo>& pools) const {
+			std::ostringstream str;
+			metric(str, pools, "mempool_capacity_objects", "Objects the pool has room for without growing", &PoolInfo::capacity);
+			metric(str, pools, "mempool_live_objects", "Objects currently allocated from the pool", &PoolInfo::liveObjects);
+			metric(str, pools, "mempool_peak_objects", "Most objects allocated from the pool at once", &PoolInfo::peakObjects);
+			metric(str, pools, "mempool_blocks", "Blocks the pool holds", &PoolInfo::numBlocks);
+			metric(str, pools, "mempool_reserved_bytes", "Bytes the pool holds", &PoolInfo::reservedBytes);
+			metric(str, pools, "mempool_used_bytes", "Bytes taken up by live objects", &PoolInfo::usedBytes);
+			return str.str();
+		}
+
+		std::string snapshot(ExportFormat format) {
+			std::vector<PoolInfo> pools = getPools();
+			return format == EXPORT_JSON ? toJson(pools) : toPrometheus(pools);
+		}
+
+		// write a snapshot to path, replacing it in one step
+		bool writeFile(const std::string& path, ExportFormat format) {
+			std::string text = snapshot(format);
+			std::string temp = path + ".tmp";
+			FILE* file = fopen(temp.c_str(), "wb");
+			if (!file)
+				return false;
+			bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+			ok = fclose(file) == 0 && ok;
+			return ok && std::rename(temp.c_str(), path.c_str()) == 0;
+		}
+
+		// connect to the Unix stream socket at path, send a snapshot and hang up
+		bool writeSocket(const std::string& path, ExportFormat format) {
+#if defined(__unix__) || defined(__APPLE__)
+			sockaddr_un address;
+			memset(&address, 0, sizeof(address));
+			if (path.size() >= sizeof(address.sun_path))
+				return false;
+			address.sun_family = AF_UNIX;
+			memcpy(address.sun_path, path.c_str(), path.size());
+
+			int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+			if (fd < 0)
+				return false;
+			bool ok = connect(fd, (const sockaddr*)&address, sizeof(address)) == 0;
+			if (ok) {
+				std::string text = snapshot(format);
+				for (size_t sent = 0; ok && sent < text.size(); ) {
+					ssize_t count = ::write(fd, text.data() + sent, text.size() - sent);
+					ok = count > 0;
+					sent += ok ? (size_t)count : 0;
+				}
+			}
+			close(fd);
+			return ok;
+#else
+			return false;
+#endif
+		}
+
+	private:
+
+		struct Entry {
+			uint64_t mId;
+			DescribeFn mDescribe;
+		};
+
+		PoolRegistry() = default;
+
+		// JSON strings and Prometheus label values escape the same characters
+		static std::string escape(const std::string& text, bool prometheus) {
+			std::string result;
+			for (char c : text) {
+				if (c == '"' || c == '\\') {
+					result += '\\';
+					result += c;
+				}
+				else if (c == '\n') {
+					result += "\\n";
+				}
+				else if ((unsigned char)c < 0x20) {
+					if (!prometheus) {
+						char code[8];
+						snprintf(code, sizeof(code), "\\u%04x", (unsigned int)c);
+						result += code;
+					}
+				}
+				else {
+					result += c;
+				}
+			}
+			return result;
+		}
+
+		static void metric(std::ostringstream& str, const std::vector<PoolInfo>& pools, const char* name, const char* help, size_t PoolInfo::* value) {
+			str << "# HELP " << name << " " << help << "\n";
+			str << "# TYPE " << name << " gauge\n";
+			for (const PoolInfo& info : pools) {
+				str << name << "{id=\"" << info.id << "\",kind=\"" << escape(info.kind, true)
+					<< "\",type=\"" << escape(info.typeName, true) << "\",object_size=\"" << info.objectSize
+					<< "\"} " << info.*value << "\n";
+			}
+		}
+
+		std::mutex mMutex;
+		std::vector<Entry> mEntries;
+		uint64_t mLastId{ 0 };
+	};
+
+}
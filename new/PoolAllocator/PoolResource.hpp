@@ -0,0 +1,83 @@
+//
+//  PoolResource.hpp
+//  PoolAllocator
+//
+//  Copyright (c) 2017 Mike Allison. All rights reserved.
+//
+
+#pragma once
+
+//--------------------------------------------------------------------------------------------------
+// A std::pmr::memory_resource over a mem::PoolSet, so std::pmr containers get the size class pools
+// without being rewritten on Allocator<T, PolicyT, TraitsT>:
+//
+//   mem::PoolResource<> pools;
+//   std::pmr::map<int, std::pmr::string> map(&pools);
+//
+// Requests up to the largest size class with an alignment the pools give anyway are served from
+// the pool of their class, everything else is passed on to the upstream resource, by default the
+// one that was the default resource when the PoolResource was made.  Like the PoolSet under it, the
+// resource is single threaded with the default basic_free_list and can be shared between threads
+// with lock_free_list; in both cases the upstream resource has to be as thread safe.
+//
+// Two PoolResources are only equal when they are the same object.
+//--------------------------------------------------------------------------------------------------
+
+#include <stddef.h>
+#include <memory_resource>
+#include "PoolSet.hpp"
+
+namespace mem {
+
+	template<typename SizeClassesT = default_size_classes, typename FreeListT = basic_free_list, typename ProviderT = malloc_provider>
+	class PoolResource : public std::pmr::memory_resource
+	{
+
+	public:
+
+		typedef PoolSet<SizeClassesT, FreeListT, ProviderT> pool_set_type;
+
+		PoolResource() : mUpstream(std::pmr::get_default_resource()) {}
+		explicit PoolResource(std::pmr::memory_resource* upstream) : mUpstream(upstream) {}
+
+		PoolResource(const PoolResource&) = delete;
+		PoolResource& operator=(const PoolResource&) = delete;
+
+		std::pmr::memory_resource* upstream_resource() const { return mUpstream; }
+
+		pool_set_type& getPoolSet() { return mPools; }
+
+		// true when a request goes to a pool rather than upstream
+		static bool isPooled(size_t bytes, size_t alignment) {
+			return bytes <= pool_set_type::MAX_POOLED_SIZE && alignment <= pool_set_type::ALIGNMENT;
+		}
+
+	protected:
+
+		void* do_allocate(size_t bytes, size_t alignment) override {
+			if (!isPooled(bytes, alignment))
+				return mUpstream->allocate(bytes, alignment);
+			void* ptr = mPools.alloc(bytes);
+			if (!ptr)
+				throw std::bad_alloc();
+			return ptr;
+		}
+
+		void do_deallocate(void* ptr, size_t bytes, size_t alignment) override {
+			if (!isPooled(bytes, alignment))
+				mUpstream->deallocate(ptr, bytes, alignment);
+			else
+				mPools.free(ptr, bytes);
+		}
+
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+			return this == &other;
+		}
+
+	private:
+
+		std::pmr::memory_resource* mUpstream;
+		pool_set_type mPools;
+	};
+
+}
@@ -0,0 +1,169 @@
+//
+//  PoolSet.hpp
+//  PoolAllocator
+//
+//  Copyright (c) 2017 Mike Allison. All rights reserved.
+//
+
+#pragma once
+
+//--------------------------------------------------------------------------------------------------
+// A set of size class pools owned by whoever creates it, instead of the process wide singletons
+// behind list_pool_policy and small_object_pool_policy.  Give one to a subsystem, or to a single
+// request, and everything it allocates through pool_set_policy stays in its own blocks: its pools
+// can be trimmed, inspected and thrown away without touching anybody else's.
+//
+// Any size up to the largest class is served from the pool of its class, see SizeClasses.hpp, so
+// one set backs every type a container rebinds to.  Pools are created the first time their class
+// is used.  Bigger allocations go to operator new.
+//
+// The pools are only as thread safe as FreeListT: the default basic_free_list is for a set used by
+// one thread at a time, lock_free_list lets several threads share one.  Destroying the set frees
+// every block, containers using it have to be gone by then.
+//--------------------------------------------------------------------------------------------------
+
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include "MemoryPool.hpp"
+#include "SizeClasses.hpp"
+
+namespace mem {
+
+	template<typename SizeClassesT = default_size_classes, typename FreeListT = basic_free_list, typename ProviderT = malloc_provider>
+	class PoolSet
+	{
+
+	public:
+
+		constexpr static const size_t ALIGNMENT = alignof(unsigned char*);  // every chunk is pointer aligned
+		constexpr static const size_t MAX_POOLED_SIZE = max_size_class<SizeClassesT>();
+		constexpr static const size_t NUM_CLASSES = num_size_classes<SizeClassesT>();
+		constexpr static const unsigned int INITIAL_OBJECTS = 64;  // chunks in the first block of every pool
+
+		template<size_t classSize>
+		using pool_type = MemoryPool<classSize, ALIGNMENT, FreeListT, intrusive_layout, ProviderT>;
+
+		PoolSet() {
+			for (auto& pool : mPools)
+				pool.store(nullptr, std::memory_order_relaxed);
+		}
+
+		~PoolSet() {
+			for (size_t i = 0; i < NUM_CLASSES; ++i) {
+				if (void* pool = mPools[i].load(std::memory_order_relaxed))
+					table().destroy[i](pool);
+			}
+		}
+
+		PoolSet(const PoolSet&) = delete;
+		PoolSet& operator=(const PoolSet&) = delete;
+
+		// bytes aligned to at most ALIGNMENT
+		void* alloc(size_t bytes) {
+			if (bytes > MAX_POOLED_SIZE)
+				return ::operator new(bytes);
+			size_t index = size_class_index<SizeClassesT>(bytes);
+			return table().alloc[index](getPool(index));
+		}
+
+		// bytes has to be what the memory was allocated with
+		void free(void* ptr, size_t bytes) {
+			if (ptr == nullptr)
+				return;
+			if (bytes > MAX_POOLED_SIZE) {
+				::operator delete(ptr);
+				return;
+			}
+			size_t index = size_class_index<SizeClassesT>(bytes);
+			table().free[index](mPools[index].load(std::memory_order_acquire), ptr);
+		}
+
+		// trim every pool that was created, see MemoryPool::trim().  Returns the bytes given back
+		size_t trim(TrimMode mode = TRIM_RELEASE) {
+			size_t released = 0;
+			for (size_t i = 0; i < NUM_CLASSES; ++i) {
+				if (void* pool = mPools[i].load(std::memory_order_acquire))
+					released += table().trim[i](pool, mode);
+			}
+			return released;
+		}
+
+		// what all pools together hold on to
+		size_t getReservedBytes() {
+			size_t reserved = 0;
+			for (size_t i = 0; i < NUM_CLASSES; ++i) {
+				if (void* pool = mPools[i].load(std::memory_order_acquire))
+					reserved += table().reserved[i](pool);
+			}
+			return reserved;
+		}
+
+	private:
+
+		// the pools have a type per class, they are kept untyped and reached through one function per
+		// class and operation
+		struct Table
+		{
+			void* (*create[NUM_CLASSES])();
+			void (*destroy[NUM_CLASSES])(void* pool);
+			void* (*alloc[NUM_CLASSES])(void* pool);
+			void (*free[NUM_CLASSES])(void* pool, void* ptr);
+			size_t (*trim[NUM_CLASSES])(void* pool, TrimMode mode);
+			size_t (*reserved[NUM_CLASSES])(void* pool);
+		};
+
+		template<size_t classSize>
+		struct Ops
+		{
+			typedef pool_type<classSize> PoolT;
+
+			static void* create() {
+				std::unique_ptr<PoolT> pool = PoolT::create();
+				pool->init(INITIAL_OBJECTS);
+				return pool.release();
+			}
+			static void destroy(void* pool) { delete (PoolT*)pool; }
+			static void* alloc(void* pool) { return ((PoolT*)pool)->alloc(); }
+			static void free(void* pool, void* ptr) { ((PoolT*)pool)->free(ptr); }
+			static size_t trim(void* pool, TrimMode mode) { return ((PoolT*)pool)->trim(mode); }
+			static size_t reserved(void* pool) { return ((PoolT*)pool)->getReservedBytes(); }
+		};
+
+		template<size_t... indices>
+		static const Table& table(std::index_sequence<indices...>) {
+			static const Table sTable = {
+				{ &Ops<SizeClassesT::CLASSES[indices]>::create... },
+				{ &Ops<SizeClassesT::CLASSES[indices]>::destroy... },
+				{ &Ops<SizeClassesT::CLASSES[indices]>::alloc... },
+				{ &Ops<SizeClassesT::CLASSES[indices]>::free... },
+				{ &Ops<SizeClassesT::CLASSES[indices]>::trim... },
+				{ &Ops<SizeClassesT::CLASSES[indices]>::reserved... }
+			};
+			return sTable;
+		}
+
+		static const Table& table() { return table(std::make_index_sequence<NUM_CLASSES>()); }
+
+		// the pool of a class, created on first use
+		void* getPool(size_t index) {
+			void* pool = mPools[index].load(std::memory_order_acquire);
+			if (pool)
+				return pool;
+			std::lock_guard<std::mutex> lock(mCreateMutex);
+			pool = mPools[index].load(std::memory_order_relaxed);
+			if (!pool) {
+				pool = table().create[index]();
+				mPools[index].store(pool, std::memory_order_release);
+			}
+			return pool;
+		}
+
+		std::atomic<void*> mPools[NUM_CLASSES];
+		std::mutex mCreateMutex;
+	};
+
+}
@@ -0,0 +1,106 @@
+//
+//  PoolSetPolicy.hpp
+//  PoolAllocator
+//
+//  Copyright (c) 2017 Mike Allison. All rights reserved.
+//
+
+#pragma once
+
+#include <new>
+#include <type_traits>
+#include "AllocatorTraits.hpp"
+#include "Allocator.hpp"
+#include "PoolSet.hpp"
+#include "HeapProfiler.hpp"
+
+// A stateful policy: every allocator points at the mem::PoolSet it was constructed with, and so do
+// all its copies and rebinds.  Two allocators are equal when they share a set, which is what lets
+// containers on the same set move, swap and splice in O(1).  The set goes along with the contents
+// on copy assignment, move assignment and swap, so memory always goes back to the set it came
+// from.  There is no default constructor, a container needs to be handed its set:
+//
+//   mem::PoolSet<> pools;
+//   std::list<Node, Allocator<Node, pool_set_policy<Node>>> list(pools);
+//
+// Types aligned above PoolSetT::ALIGNMENT go to operator new.
+//
+// Allocations are sampled by the HeapProfiler while it is running.
+template<typename T, typename PoolSetT = mem::PoolSet<>>
+class pool_set_policy
+{
+public:
+
+	ALLOCATOR_TRAITS(T)
+
+	typedef PoolSetT pool_set_type;
+
+	typedef std::true_type propagate_on_container_copy_assignment;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+	typedef std::false_type is_always_equal;
+
+	constexpr static const bool POOLED = alignof(T) <= PoolSetT::ALIGNMENT;
+
+	template<typename U>
+	struct rebind
+	{
+		typedef pool_set_policy<U, PoolSetT> other;
+	};
+
+	// Constructor
+	pool_set_policy(PoolSetT& pools) : mPools(&pools) {}
+
+	// Copy Constructor
+	template<typename U>
+	pool_set_policy(pool_set_policy<U, PoolSetT> const& other) : mPools(&other.getPoolSet()) {}
+
+	// Allocate memory
+	pointer allocate(size_type count, const_pointer = 0)
+	{
+		if (count > max_size()) { throw std::bad_alloc(); }
+		pointer ptr;
+		if (POOLED)
+			ptr = static_cast<pointer>(mPools->alloc(count * sizeof(T)));
+		else
+			ptr = static_cast<pointer>(::operator new(count * sizeof(T), std::align_val_t(alignof(T))));
+
+		mem::HeapProfiler::recordAlloc(ptr, count * sizeof(T));
+		return ptr;
+	}
+
+	// Delete memory
+	void deallocate(pointer ptr, size_type count)
+	{
+		mem::HeapProfiler::recordFree(ptr);
+		if (POOLED)
+			mPools->free(ptr, count * sizeof(T));
+		else
+			::operator delete(ptr, std::align_val_t(alignof(T)));
+	}
+
+	// Max number of objects that can be allocated in one call
+	size_type max_size(void) const { return max_allocations<T>::value; }
+
+	PoolSetT& getPoolSet() const { return *mPools; }
+
+private:
+
+	PoolSetT* mPools;
+};
+
+// Allocators on the same set can free each other's memory
+template<typename T, typename U, typename PoolSetT, typename TraitsT, typename TraitsU>
+bool operator==(Allocator<T, pool_set_policy<T, PoolSetT>, TraitsT> const& left,
+				Allocator<U, pool_set_policy<U, PoolSetT>, TraitsU> const& right)
+{
+	return &left.getPoolSet() == &right.getPoolSet();
+}
+
+// Also implement inequality
+template<typename T, typename U, typename PoolSetT, typename TraitsT, typename TraitsU>
+bool operator!=(Allocator<T, pool_set_policy<T, PoolSetT>, TraitsT> const& left,
+				Allocator<U, pool_set_policy<U, PoolSetT>, TraitsU> const& right)
+{
+	return !(left == right);
+}
@@ -0,0 +1,157 @@
+//
+//  PoolStats.hpp
+//  PoolAllocator
+//
+//  Copyright (c) 2017 Mike Allison. All rights reserved.
+//
+
+#pragma once
+
+//--------------------------------------------------------------------------------------------------
+// Always-on pool statistics.  The hot path counters (allocs, frees, failed allocs) are split into
+// per-thread slots: every thread gets a slot number of its own for as long as it lives, and only
+// ever writes its own cache line with a plain relaxed load and store, no read-modify-write and no
+// sharing.  getStats() sums the slots, so reading costs O(MAX_THREAD_SLOTS) and writing next to
+// nothing.  Threads past MAX_THREAD_SLOTS share one overflow slot and pay for an atomic add.
+//
+// A sum taken while other threads are allocating is not a snapshot, each counter is exact but they
+// may be a few operations apart from each other.
+//--------------------------------------------------------------------------------------------------
+
+#include <stddef.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace mem {
+
+	struct PoolStats
+	{
+		unsigned long allocs;  // successful alloc() calls
+		unsigned long frees;  // free() calls with a non-null pointer
+		unsigned long failedAllocs;  // alloc() calls that returned nullptr
+		unsigned long liveObjects;  // allocs - frees
+		unsigned long peakObjects;  // the most objects that were live at once
+		unsigned long grows;  // blocks the pool got from its provider
+		size_t numBlocks;
+		size_t capacity;  // chunks in the committed blocks
+		size_t reservedBytes;  // what the committed blocks take up
+		size_t usedBytes;  // what the live objects take up, the rest of reservedBytes is overhead or free
+	};
+
+	// a small number for every running thread, handed back when the thread exits so the numbers stay dense
+	class ThreadSlot
+	{
+	public:
+
+		constexpr static const unsigned int MAX_THREAD_SLOTS = 64;
+		constexpr static const unsigned int SHARED_SLOT = MAX_THREAD_SLOTS;  // every thread past the limit
+
+		static unsigned int get() {
+			if (tSlot == UNASSIGNED) {
+				static thread_local Holder holder;
+				return holder.mSlot;
+			}
+			return tSlot;
+		}
+
+	private:
+
+		constexpr static const unsigned int UNASSIGNED = ~0u;
+
+		struct Registry {
+			std::mutex mMutex;
+			std::vector<unsigned int> mFree;
+			unsigned int mNext{ 0 };
+		};
+
+		// never destroyed, threads may exit after static destruction started
+		static Registry& registry() {
+			static Registry* sRegistry = new Registry;
+			return *sRegistry;
+		}
+
+		struct Holder {
+			Holder() {
+				Registry& reg = registry();
+				std::lock_guard<std::mutex> lock(reg.mMutex);
+				if (!reg.mFree.empty()) {
+					mSlot = reg.mFree.back();
+					reg.mFree.pop_back();
+				}
+				else {
+					mSlot = reg.mNext < MAX_THREAD_SLOTS ? reg.mNext++ : SHARED_SLOT;
+				}
+				tSlot = mSlot;
+			}
+			~Holder() {
+				tSlot = SHARED_SLOT;
+				if (mSlot == SHARED_SLOT)
+					return;
+				Registry& reg = registry();
+				std::lock_guard<std::mutex> lock(reg.mMutex);
+				reg.mFree.push_back(mSlot);
+			}
+			unsigned int mSlot;
+		};
+
+		static inline thread_local unsigned int tSlot = UNASSIGNED;
+	};
+
+	// the per-thread counters of one pool
+	class PoolCounters
+	{
+	public:
+
+		void countAlloc() { bump(&Slot::mAllocs); }
+		void countFree() { bump(&Slot::mFrees); }
+		void countFailedAlloc() { bump(&Slot::mFailedAllocs); }
+
+		// fills in allocs, frees, failedAllocs and liveObjects
+		void read(PoolStats& stats) const {
+			stats.allocs = 0;
+			stats.frees = 0;
+			stats.failedAllocs = 0;
+			for (const Slot& slot : mSlots) {
+				stats.allocs += slot.mAllocs.load(std::memory_order_relaxed);
+				stats.frees += slot.mFrees.load(std::memory_order_relaxed);
+				stats.failedAllocs += slot.mFailedAllocs.load(std::memory_order_relaxed);
+			}
+			stats.liveObjects = stats.allocs > stats.frees ? stats.allocs - stats.frees : 0;
+		}
+
+		unsigned long liveObjects() const {
+			PoolStats stats;
+			read(stats);
+			return stats.liveObjects;
+		}
+
+		void clear() {
+			for (Slot& slot : mSlots) {
+				slot.mAllocs.store(0, std::memory_order_relaxed);
+				slot.mFrees.store(0, std::memory_order_relaxed);
+				slot.mFailedAllocs.store(0, std::memory_order_relaxed);
+			}
+		}
+
+	private:
+
+		struct alignas(64) Slot {
+			std::atomic<unsigned long> mAllocs{ 0 };
+			std::atomic<unsigned long> mFrees{ 0 };
+			std::atomic<unsigned long> mFailedAllocs{ 0 };
+		};
+
+		void bump(std::atomic<unsigned long> Slot::* counter) {
+			unsigned int index = ThreadSlot::get();
+			std::atomic<unsigned long>& value = mSlots[index].*counter;
+			if (index == ThreadSlot::SHARED_SLOT)
+				value.fetch_add(1, std::memory_order_relaxed);
+			else
+				value.store(value.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+
+		Slot mSlots[ThreadSlot::MAX_THREAD_SLOTS + 1];
+	};
+
+}
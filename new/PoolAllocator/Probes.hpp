@@ -0,0 +1,40 @@
+//
+//  Probes.hpp
+//  PoolAllocator
+//
+//  Copyright (c) 2017 Mike Allison. All rights reserved.
+//
+
+#pragma once
+
+//--------------------------------------------------------------------------------------------------
+// USDT (SystemTap style) static probes on the pools' slow paths.  Build with MEM_USDT_PROBES defined
+// and <sys/sdt.h> installed (systemtap-sdt-dev or systemtap-sdt-devel) to compile them in.  Each probe
+// is a single nop until a tracer attaches to it, so they can stay in production builds.  Without
+// MEM_USDT_PROBES they compile to nothing, with it and without the header the build stops.
+//
+// DTRACE_PROBEn passes its arguments as asm operands, so they have to be plain integers or pointers:
+// load atomics before handing them over.
+//
+// All probes belong to the provider mempool.  The first argument is always the pool's address:
+//
+//   pool_grow(pool, object_size, block_objects, block_bytes)    MemoryPool got a block
+//   pool_trim(pool, object_size, mode, released_bytes)          MemoryPool::trim() ran
+//   pool_exhausted(pool, object_size, capacity)                 MemoryPool::alloc() returned nullptr
+//   objectpool_block_create(pool, block_index, block_bytes)     ObjectPool allocated a block
+//   objectpool_relocate(pool, from_index, to_index)             ObjectPool moved its last object into a hole
+//
+// e.g. bpftrace -e 'usdt:./objectpool:mempool:pool_grow { @[arg1] = sum(arg3); }'
+//--------------------------------------------------------------------------------------------------
+
+#if defined(MEM_USDT_PROBES)
+#if !__has_include(<sys/sdt.h>)
+#error "MEM_USDT_PROBES needs <sys/sdt.h>, install systemtap-sdt-dev or systemtap-sdt-devel"
+#endif
+#include <sys/sdt.h>
+#define MEM_PROBE3(name, a, b, c) DTRACE_PROBE3(mempool, name, a, b, c)
+#define MEM_PROBE4(name, a, b, c, d) DTRACE_PROBE4(mempool, name, a, b, c, d)
+#else
+#define MEM_PROBE3(name, a, b, c) ((void)0)
+#define MEM_PROBE4(name, a, b, c, d) ((void)0)
+#endif
@@ -0,0 +1,157 @@
+//
+//  SizeClasses.hpp
+//  PoolAllocator
+//
+//  Copyright (c) 2017 Mike Allison. All rights reserved.
+//
+
+#pragma once
+
+//--------------------------------------------------------------------------------------------------
+// Size classes for small_object_pool_policy.  Instead of one pool per distinct sizeof(T), every
+// size is rounded up to the smallest class that fits and all sizes in a class share that class's
+// pool, so a program with dozens of slightly different node types ends up with a handful of busy
+// pools instead of dozens of mostly empty ones.
+//
+// A size class table is any type with a static constexpr CLASSES array in ascending order, the
+// last entry being the largest size that is pooled.  default_size_classes follows jemalloc's
+// spacing: 8, then steps of 16 up to 128, then four classes per doubling.
+//
+// The price is internal fragmentation, the bytes between an object's size and its class.  Every
+// size that gets routed into a class is recorded in the SizeClassRegistry, which can report the
+// waste per size next to what each class pool has reserved.
+//--------------------------------------------------------------------------------------------------
+
+#include <stddef.h>
+#include <algorithm>
+#include <iomanip>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace mem {
+
+	struct default_size_classes
+	{
+		constexpr static const size_t CLASSES[] = { 8, 16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256 };
+	};
+
+	template<typename SizeClassesT>
+	constexpr size_t num_size_classes() {
+		return sizeof(SizeClassesT::CLASSES) / sizeof(SizeClassesT::CLASSES[0]);
+	}
+
+	template<typename SizeClassesT>
+	constexpr size_t max_size_class() {
+		return SizeClassesT::CLASSES[num_size_classes<SizeClassesT>() - 1];
+	}
+
+	// the smallest class that fits size, or 0 when it is bigger than every class
+	template<typename SizeClassesT>
+	constexpr size_t size_class_of(size_t size) {
+		for (size_t c : SizeClassesT::CLASSES) {
+			if (size <= c)
+				return c;
+		}
+		return 0;
+	}
+
+	// the position of size_class_of() in the table, num_size_classes() when size doesn't fit
+	template<typename SizeClassesT>
+	constexpr size_t size_class_index(size_t size) {
+		size_t index = 0;
+		while (index < num_size_classes<SizeClassesT>() && size > SizeClassesT::CLASSES[index])
+			++index;
+		return index;
+	}
+
+	struct SizeClassInfo
+	{
+		size_t classSize;  // bytes per slot
+		size_t alignment;
+		std::set<size_t> objectSizes;  // every size routed into this class
+		size_t capacity;  // slots the class pool has reserved
+		size_t reservedBytes;  // bytes the class pool has reserved, padding included
+
+		size_t worstWaste() const { return objectSizes.empty() ? 0 : classSize - *objectSizes.begin(); }
+	};
+
+	class SizeClassRegistry
+	{
+	public:
+
+		// reports the capacity and reserved bytes of a class pool
+		typedef void (*UsageFn)(size_t& capacity, size_t& reservedBytes);
+
+		// never destroyed, an allocation during static destruction may still register its class
+		static SizeClassRegistry& get() {
+			static SizeClassRegistry* sInstance = new SizeClassRegistry;
+			return *sInstance;
+		}
+
+		// record that objects of objectSize are served by the class pool, returns true so it can
+		// initialize a static
+		bool add(size_t classSize, size_t alignment, size_t objectSize, UsageFn usage) {
+			std::lock_guard<std::mutex> lock(mMutex);
+			for (auto& entry : mClasses) {
+				if (entry.classSize == classSize && entry.alignment == alignment) {
+					entry.objectSizes.insert(objectSize);
+					return true;
+				}
+			}
+			mClasses.push_back(Entry{ classSize, alignment, { objectSize }, usage });
+			return true;
+		}
+
+		std::vector<SizeClassInfo> getClasses() {
+			std::lock_guard<std::mutex> lock(mMutex);
+			std::vector<SizeClassInfo> classes;
+			for (auto& entry : mClasses) {
+				SizeClassInfo info{ entry.classSize, entry.alignment, entry.objectSizes, 0, 0 };
+				entry.usage(info.capacity, info.reservedBytes);
+				classes.push_back(info);
+			}
+			std::sort(classes.begin(), classes.end(), [](const SizeClassInfo& a, const SizeClassInfo& b) {
+				return a.classSize < b.classSize || (a.classSize == b.classSize && a.alignment < b.alignment);
+			});
+			return classes;
+		}
+
+		// one line per class: the slot size, what the pool holds and the waste of every size in it
+		std::string report() {
+			std::ostringstream str;
+			size_t totalReserved = 0;
+			str << " class  align  capacity  reserved  sizes (bytes wasted per object)\n";
+			for (auto& info : getClasses()) {
+				str << std::setw(6) << info.classSize << std::setw(7) << info.alignment
+					<< std::setw(10) << info.capacity << std::setw(10) << info.reservedBytes << "  ";
+				for (size_t size : info.objectSizes) {
+					size_t waste = info.classSize - size;
+					str << size << " (" << waste << ", " << std::fixed << std::setprecision(1) << 100.0 * waste / info.classSize << "%) ";
+				}
+				str << "\n";
+				totalReserved += info.reservedBytes;
+			}
+			str << "total reserved: " << totalReserved << " bytes\n";
+			return str.str();
+		}
+
+	private:
+
+		struct Entry
+		{
+			size_t classSize;
+			size_t alignment;
+			std::set<size_t> objectSizes;
+			UsageFn usage;
+		};
+
+		SizeClassRegistry() = default;
+
+		std::mutex mMutex;
+		std::vector<Entry> mClasses;
+	};
+
+}
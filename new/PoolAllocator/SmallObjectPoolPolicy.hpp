@@ -13,55 +13,115 @@
 #include <memory>
 #include <string>
 #include <array>
+#include <atomic>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <stdint.h>
 #include "AllocatorTraits.hpp"
+#include "Allocator.hpp"
 #include "MemoryPool.hpp"
+#include "ThreadCache.hpp"
+#include "SizeClasses.hpp"
+#include "HeapProfiler.hpp"
 
-template<typename T>
+// alignment raises the alignment of every object above alignof(T), e.g. mem::CACHE_LINE_SIZE keeps
+// hot objects from sharing or straddling cache lines.  It carries over when containers rebind.
+//
+// Objects are pooled by size class rather than by exact size, see SizeClasses.hpp.  SizeClassesT
+// is the class table to use, it also carries over when containers rebind.
+//
+// Arrays whose total size fits a class are pooled too, routed by their size in bytes, so short
+// vectors, strings and small hash tables share the class pools with the single objects.  The count
+// passed to deallocate() picks the same class again.  The first array of every length is recorded
+// in the SizeClassRegistry under its size in bytes.
+//
+// Allocations are sampled by the HeapProfiler while it is running.
+template<typename T, size_t alignment = 0, typename SizeClassesT = mem::default_size_classes>
 class small_object_pool_policy
 {
 public:
 
-	constexpr static const size_t MAX_SMALL_OBJECT_SIZE = 256;
+	constexpr static const size_t MAX_SMALL_OBJECT_SIZE = mem::max_size_class<SizeClassesT>();
 
 	ALLOCATOR_TRAITS(T)
 
+	// every allocator of a type shares the same pools
+	typedef std::true_type is_always_equal;
+
+	constexpr static const size_t ALIGNMENT = alignof(T) > alignment ? alignof(T) : alignment;
+
+	// the slot size T is served from, chunks are pointer aligned anyway so anything below that shares
+	// the pointer aligned pool
+	constexpr static const size_t SIZE_CLASS = sizeof(T) <= MAX_SMALL_OBJECT_SIZE ? mem::size_class_of<SizeClassesT>(sizeof(T)) : sizeof(T);
+	constexpr static const size_t POOL_ALIGNMENT = mem::chunk_alignment(ALIGNMENT);
+
+	// every thread allocates through its own magazines in front of the shared class pool, and the free
+	// list link lives inside free slots so a chunk is no bigger than the class
+	typedef mem::ThreadCache<mem::MemoryPool<SIZE_CLASS, POOL_ALIGNMENT, mem::basic_free_list, mem::intrusive_layout>> pool_type;
+
+	// the pool of any class at T's alignment, pool_type is one of them
+	template<size_t classSize>
+	using class_pool_type = mem::ThreadCache<mem::MemoryPool<classSize, POOL_ALIGNMENT, mem::basic_free_list, mem::intrusive_layout>>;
+
+	// the most objects in an array that is still pooled
+	constexpr static const size_t MAX_SMALL_ARRAY = MAX_SMALL_OBJECT_SIZE / sizeof(T);
+
 	template<typename U>
 	struct rebind
 	{
-		typedef small_object_pool_policy<U> other;
+		typedef small_object_pool_policy<U, alignment, SizeClassesT> other;
 	};
 
 	// Default Constructor
 	small_object_pool_policy() {
-		mem::MemoryPool<sizeof(T)>::get();
+		pool_type::getPool();
+		registerSizeClass();
 	}
 
 	// Copy Constructor
 	template<typename U>
-	small_object_pool_policy(small_object_pool_policy<U> const& other) {}
+	small_object_pool_policy(small_object_pool_policy<U, alignment, SizeClassesT> const&) {
+		registerSizeClass();
+	}
 
 	// Allocate memory
-	pointer allocate(size_type count, const_pointer hint = 0)
+	pointer allocate(size_type count, const_pointer = 0)
 	{
-
+		pointer ptr;
 		if (sizeof(T) <= MAX_SMALL_OBJECT_SIZE && count == 1) {
 			//object is correct size and only one is requested
-			return static_cast<pointer>(mem::MemoryPool<sizeof(T)>::get()->alloc());
+			ptr = static_cast<pointer>(pool_type::alloc());
+		}
+		else if (count <= MAX_SMALL_ARRAY) {
+			size_t index = mem::size_class_index<SizeClassesT>(count * sizeof(T));
+			recordArray(count, index);
+			ptr = static_cast<pointer>(allocArray(index, ClassIndices()));
 		}
 		else {
 			if (count > max_size()) { throw std::bad_alloc(); }
-			return static_cast<pointer>(::operator new(count * sizeof(type), ::std::nothrow));
+			if (ALIGNMENT > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+				ptr = static_cast<pointer>(::operator new(count * sizeof(type), std::align_val_t(ALIGNMENT), ::std::nothrow));
+			else
+				ptr = static_cast<pointer>(::operator new(count * sizeof(type), ::std::nothrow));
 		}
 
-		return nullptr;
-
+		mem::HeapProfiler::recordAlloc(ptr, count * sizeof(type));
+		return ptr;
 	}
 
 	// Delete memory
 	void deallocate(pointer ptr, size_type count)
 	{
+		mem::HeapProfiler::recordFree(ptr);
 		if (sizeof(T) <= MAX_SMALL_OBJECT_SIZE && count == 1) {
-			mem::MemoryPool<sizeof(T)>::get()->free(ptr);
+			pool_type::free(ptr);
+		}
+		else if (count <= MAX_SMALL_ARRAY) {
+			freeArray(mem::size_class_index<SizeClassesT>(count * sizeof(T)), ptr, ClassIndices());
+		}
+		else if (ALIGNMENT > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+			::operator delete(ptr, std::align_val_t(ALIGNMENT));
 		}
 		else {
 			::operator delete(ptr);
@@ -70,22 +130,76 @@ public:
 
 	// Max number of objects that can be allocated in one call
 	size_type max_size(void) const { return max_allocations<T>::value; }
+
+private:
+
+	typedef std::make_index_sequence<mem::num_size_classes<SizeClassesT>()> ClassIndices;
+
+	template<size_t... indices>
+	static void* allocArray(size_t index, std::index_sequence<indices...>) {
+		static void* (*const sAllocs[])() = { &class_pool_type<SizeClassesT::CLASSES[indices]>::alloc... };
+		return sAllocs[index]();
+	}
+
+	template<size_t... indices>
+	static void freeArray(size_t index, void* ptr, std::index_sequence<indices...>) {
+		static void (*const sFrees[])(void*) = { &class_pool_type<SizeClassesT::CLASSES[indices]>::free... };
+		sFrees[index](ptr);
+	}
+
+	// let the registry know the first time an array of count objects is allocated, a relaxed load
+	// every time after that
+	static void recordArray(size_type count, size_t index) {
+		std::atomic<uint64_t>& word = sArraysSeen[count / 64];
+		uint64_t bit = uint64_t(1) << (count % 64);
+		if (word.load(std::memory_order_relaxed) & bit)
+			return;
+		if (!(word.fetch_or(bit, std::memory_order_relaxed) & bit))
+			registerArray(index, count * sizeof(T), ClassIndices());
+	}
+
+	template<size_t... indices>
+	static void registerArray(size_t index, size_t bytes, std::index_sequence<indices...>) {
+		static const mem::SizeClassRegistry::UsageFn sUsages[] = { &classUsage<SizeClassesT::CLASSES[indices]>... };
+		mem::SizeClassRegistry::get().add(SizeClassesT::CLASSES[index], POOL_ALIGNMENT, bytes, sUsages[index]);
+	}
+
+	template<size_t classSize>
+	static void classUsage(size_t& capacity, size_t& reservedBytes) {
+		class_pool_type<classSize>::visitPool([&](typename class_pool_type<classSize>::pool_type& pool) {
+			capacity = pool.getCapacity();
+			reservedBytes = pool.getReservedBytes();
+		});
+	}
+
+	// let the registry know T lives in this class, once per type
+	static void registerSizeClass() {
+		if (sizeof(T) > MAX_SMALL_OBJECT_SIZE)
+			return;
+		static const bool registered = mem::SizeClassRegistry::get().add(SIZE_CLASS, POOL_ALIGNMENT, sizeof(T), &classUsage<SIZE_CLASS>);
+		(void)registered;
+	}
+
+	// a bit per array length already recorded.  Bit 0 starts set, there is nothing to record for an
+	// empty array
+	static inline std::atomic<uint64_t> sArraysSeen[MAX_SMALL_ARRAY / 64 + 1] = { 1 };
 };
 
-// Specialize for the small pool policy
-template<typename T, typename TraitsT,
-	typename U, typename TraitsU>
-	bool operator==(Allocator<T, small_object_pool_policy<T>, TraitsT> const& left,
-		Allocator<U, small_object_pool_policy<U>, TraitsU> const& right)
+// Specialize for the small pool policy, the class pools are singletons so allocators that rebind to
+// each other always are
+template<typename T, size_t AlignT, typename ClassesT, typename TraitsT,
+	typename U, size_t AlignU, typename ClassesU, typename TraitsU>
+	bool operator==(Allocator<T, small_object_pool_policy<T, AlignT, ClassesT>, TraitsT> const&,
+		Allocator<U, small_object_pool_policy<U, AlignU, ClassesU>, TraitsU> const&)
 {
-	return false;
+	return AlignT == AlignU && std::is_same<ClassesT, ClassesU>::value;
 }
 
 // Also implement inequality
-template<typename T, typename TraitsT,
-	typename U, typename TraitsU>
-	bool operator!=(Allocator<T, small_object_pool_policy<T>, TraitsT> const& left,
-		Allocator<U, small_object_pool_policy<U>, TraitsU> const& right)
+template<typename T, size_t AlignT, typename ClassesT, typename TraitsT,
+	typename U, size_t AlignU, typename ClassesU, typename TraitsU>
+	bool operator!=(Allocator<T, small_object_pool_policy<T, AlignT, ClassesT>, TraitsT> const& left,
+		Allocator<U, small_object_pool_policy<U, AlignU, ClassesU>, TraitsU> const& right)
 {
 	return !(left == right);
 }
\ No newline at end of file
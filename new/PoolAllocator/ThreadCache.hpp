@@ -0,0 +1,336 @@
+//
+//  ThreadCache.hpp
+//  PoolAllocator
+//
+//  Copyright (c) 2017 Mike Allison. All rights reserved.
+//
+
+#pragma once
+
+//--------------------------------------------------------------------------------------------------
+// A per-thread magazine layer that sits in front of a MemoryPool singleton so several threads can
+// share one pool without taking a lock on every alloc() and free().
+//
+// Every thread owns two magazines, "loaded" and "previous", each a small stack of up to
+// MAGAZINE_SIZE free chunks.  alloc() pops from the loaded magazine and free() pushes onto it; when
+// the loaded magazine runs empty (or full) it is swapped with the previous one.  Only when both are
+// empty (or both full) does the thread go to the shared depot, which trades a whole magazine at a
+// time under a mutex: an empty one for a full one on alloc, a full one for an empty one on free.
+// When the depot has no full magazines it fills one straight from the MemoryPool.  The lock is
+// therefore taken at most once every MAGAZINE_SIZE operations.
+//
+// Chunks freed on a different thread than they were allocated on simply land in the freeing
+// thread's magazine and flow back through the depot.  When a thread exits its magazines are handed
+// back to the depot, so no chunks are stranded.
+//--------------------------------------------------------------------------------------------------
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <utility>
+#include "MemoryPool.hpp"
+
+namespace mem {
+
+	template<typename PoolT>
+	class ThreadCache
+	{
+
+	public:
+
+		typedef PoolT pool_type;
+
+		constexpr static const unsigned int MAGAZINE_SIZE = 64;  // chunks per magazine
+		constexpr static const unsigned int MAX_DEPOT_MAGAZINES = 32;  // full magazines the depot keeps before returning chunks to the pool
+
+		static void* alloc(void) {
+			// fast path: pop from this thread's loaded magazine, no locks, no atomics
+			Cache* cache = tCache;
+			if (cache && cache->mLoaded->mCount)
+				return cache->mLoaded->mRounds[--cache->mLoaded->mCount];
+
+			return allocSlow();
+		}
+
+		static void free(void* ptr) {
+			if (ptr == nullptr)
+				return;
+
+			// fast path: push onto this thread's loaded magazine
+			Cache* cache = tCache;
+			if (cache && cache->mLoaded->mCount < MAGAZINE_SIZE) {
+				cache->mLoaded->mRounds[cache->mLoaded->mCount++] = ptr;
+				return;
+			}
+
+			freeSlow(ptr);
+		}
+
+		// hand the calling thread's cached chunks back to the depot
+		static void flush(void) {
+			if (Cache* cache = tCache)
+				depot()->release(*cache);
+		}
+
+		// the pool behind the depot, created on first use
+		static PoolT* getPool(void) { return depot()->getPool(); }
+
+		// call fn(pool) with the depot locked, for anything that needs to look at the pool while other
+		// threads are allocating
+		template<typename FnT>
+		static void visitPool(FnT fn) { depot()->visit(fn); }
+
+		// the pool's stats, chunks sitting in magazines count as live since the pool handed them out
+		static PoolStats getStats(void) {
+			PoolStats stats;
+			visitPool([&](PoolT& pool) { stats = pool.getStats(); });
+			return stats;
+		}
+
+		// trim the pool, see MemoryPool::trim().  The calling thread's magazines and the depot's full
+		// ones go back to the pool first, chunks cached by other threads keep their blocks alive
+		static size_t trim(TrimMode mode = TRIM_RELEASE) {
+			flush();
+			return depot()->trim(mode);
+		}
+
+	private:
+
+		struct Magazine {
+			unsigned int mCount{ 0 };
+			void* mRounds[MAGAZINE_SIZE];
+		};
+
+		struct Cache {
+			Magazine* mLoaded{ nullptr };
+			Magazine* mPrevious{ nullptr };
+		};
+
+		class Depot
+		{
+		public:
+
+			// the pool is single threaded, so the registry has to read it under the depot lock
+			Depot() : mPool(PoolT::get()), mRegistryId(mPool->getRegistryId()) {
+				PoolRegistry::get().setDescribe(mRegistryId, [this] {
+					std::lock_guard<std::mutex> lock(mMutex);
+					return mPool->describe();
+				});
+			}
+
+			// the pool owns the chunks themselves, the depot only owns the magazines
+			~Depot() {
+				// a no-op when the pool has already left the registry
+				PoolT* pool = mPool;
+				PoolRegistry::get().setDescribe(mRegistryId, [pool] { return pool->describe(); });
+				for (auto magazine : mFull)
+					delete magazine;
+				for (auto magazine : mEmpty)
+					delete magazine;
+			}
+
+			PoolT* getPool(void) const { return mPool; }
+
+			template<typename FnT>
+			void visit(FnT& fn) {
+				std::lock_guard<std::mutex> lock(mMutex);
+				fn(*mPool);
+			}
+
+			// give the depot an empty magazine and get a full one back
+			Magazine* exchangeEmpty(Magazine* empty) {
+				std::lock_guard<std::mutex> lock(mMutex);
+
+				if (!mFull.empty()) {
+					Magazine* full = mFull.back();
+					mFull.pop_back();
+					mEmpty.push_back(empty);
+					return full;
+				}
+
+				// no full magazines around, fill this one directly from the pool
+				while (empty->mCount < MAGAZINE_SIZE) {
+					void* chunk = mPool->alloc();
+					if (!chunk)
+						break;
+					empty->mRounds[empty->mCount++] = chunk;
+				}
+				return empty;
+			}
+
+			// give the depot a full magazine and get an empty one back
+			Magazine* exchangeFull(Magazine* full) {
+				std::lock_guard<std::mutex> lock(mMutex);
+
+				// the depot has enough on hand, let the pool have the chunks back
+				if (mFull.size() >= MAX_DEPOT_MAGAZINES) {
+					drain(full);
+					return full;
+				}
+
+				mFull.push_back(full);
+				return takeEmpty();
+			}
+
+			// pass-through for threads whose cache has already been torn down
+			void* alloc(void) {
+				std::lock_guard<std::mutex> lock(mMutex);
+				return mPool->alloc();
+			}
+
+			void free(void* ptr) {
+				std::lock_guard<std::mutex> lock(mMutex);
+				mPool->free(ptr);
+			}
+
+			// take back everything a thread has cached, full magazines are kept, partial ones drained
+			void release(Cache& cache) {
+				std::lock_guard<std::mutex> lock(mMutex);
+				keep(cache.mLoaded);
+				keep(cache.mPrevious);
+				cache.mLoaded = takeEmpty();
+				cache.mPrevious = takeEmpty();
+			}
+
+			void retire(Cache& cache) {
+				std::lock_guard<std::mutex> lock(mMutex);
+				keep(cache.mLoaded);
+				keep(cache.mPrevious);
+				cache.mLoaded = nullptr;
+				cache.mPrevious = nullptr;
+			}
+
+			size_t trim(TrimMode mode) {
+				std::lock_guard<std::mutex> lock(mMutex);
+				for (auto magazine : mFull) {
+					drain(magazine);
+					mEmpty.push_back(magazine);
+				}
+				mFull.clear();
+				return mPool->trim(mode);
+			}
+
+			Magazine* newEmpty(void) {
+				std::lock_guard<std::mutex> lock(mMutex);
+				return takeEmpty();
+			}
+
+		private:
+
+			// must be called with the lock held
+			Magazine* takeEmpty(void) {
+				if (mEmpty.empty())
+					return new Magazine;
+				Magazine* empty = mEmpty.back();
+				mEmpty.pop_back();
+				return empty;
+			}
+
+			void drain(Magazine* magazine) {
+				while (magazine->mCount)
+					mPool->free(magazine->mRounds[--magazine->mCount]);
+			}
+
+			void keep(Magazine* magazine) {
+				if (!magazine)
+					return;
+				if (magazine->mCount == MAGAZINE_SIZE && mFull.size() < MAX_DEPOT_MAGAZINES) {
+					mFull.push_back(magazine);
+				}
+				else {
+					drain(magazine);
+					mEmpty.push_back(magazine);
+				}
+			}
+
+			std::mutex mMutex;
+			PoolT* mPool;
+			uint64_t mRegistryId;
+			std::vector<Magazine*> mFull;
+			std::vector<Magazine*> mEmpty;
+		};
+
+		// owns the thread's cache, its destructor runs at thread exit and returns the magazines
+		struct CacheHolder {
+			CacheHolder() {
+				mCache.mLoaded = depot()->newEmpty();
+				mCache.mPrevious = depot()->newEmpty();
+				tCache = &mCache;
+			}
+			~CacheHolder() {
+				tCache = nullptr;
+				tShutdown = true;
+				depot()->retire(mCache);
+			}
+			Cache mCache;
+		};
+
+		static Depot* depot(void) {
+			std::call_once(sDepotFlag, [] { sDepot.reset(new Depot); });
+			return sDepot.get();
+		}
+
+		static Cache* localCache(void) {
+			if (!tCache && !tShutdown) {
+				static thread_local CacheHolder holder;
+				return &holder.mCache;
+			}
+			return tCache;
+		}
+
+		static void* allocSlow(void) {
+			Cache* cache = localCache();
+			if (!cache)
+				return depot()->alloc();
+
+			// the loaded magazine is empty, try the previous one before going to the depot
+			if (cache->mPrevious->mCount)
+				std::swap(cache->mLoaded, cache->mPrevious);
+			else
+				cache->mLoaded = depot()->exchangeEmpty(cache->mLoaded);
+
+			if (!cache->mLoaded->mCount)
+				return nullptr;  // the pool couldn't give us anything
+
+			return cache->mLoaded->mRounds[--cache->mLoaded->mCount];
+		}
+
+		static void freeSlow(void* ptr) {
+			Cache* cache = localCache();
+			if (!cache) {
+				depot()->free(ptr);
+				return;
+			}
+
+			// the loaded magazine is full, try the previous one before going to the depot
+			if (cache->mLoaded->mCount == MAGAZINE_SIZE) {
+				if (cache->mPrevious->mCount < MAGAZINE_SIZE)
+					std::swap(cache->mLoaded, cache->mPrevious);
+				else
+					cache->mLoaded = depot()->exchangeFull(cache->mLoaded);
+			}
+
+			cache->mLoaded->mRounds[cache->mLoaded->mCount++] = ptr;
+		}
+
+		static std::shared_ptr<Depot> sDepot;
+		static std::once_flag sDepotFlag;
+
+		// plain pointers so the fast path never pays for thread_local construction checks
+		static thread_local Cache* tCache;
+		static thread_local bool tShutdown;
+	};
+
+}
+
+template<typename PoolT>
+std::shared_ptr<typename mem::ThreadCache<PoolT>::Depot> mem::ThreadCache<PoolT>::sDepot;
+
+template<typename PoolT>
+std::once_flag mem::ThreadCache<PoolT>::sDepotFlag;
+
+template<typename PoolT>
+thread_local typename mem::ThreadCache<PoolT>::Cache* mem::ThreadCache<PoolT>::tCache = nullptr;
+
+template<typename PoolT>
+thread_local bool mem::ThreadCache<PoolT>::tShutdown = false;
@@ -7,17 +7,18 @@
 //
 
 #include <iostream>
-#include <chrono>
 #include <list>
-#include <random>
-#include <memory>
+#include <vector>
 
 #include "ListPoolPolicy.hpp"
 #include "Allocator.hpp"
 #include "SmallObjectPoolPolicy.hpp"
+#include "PoolSetPolicy.hpp"
+
+// Timings live in the objectpool_bench target, see bench/.  This just puts the policies through
+// their paces once and shows which pools they made.
 
 const int MAX_SIZE = 5000;
-const int MAX_ITERATIONS = 5000;
 
 class Test {
 public:
@@ -65,109 +66,35 @@ private:
 };
 
 int main(int argc, const char * argv[]) {
-	// insert code here...
 
-	auto start = std::chrono::high_resolution_clock::now();
-	auto finish = std::chrono::high_resolution_clock::now();
-	
-	{
-		std::list<Test, Allocator<Test, heap_policy<Test>>> regular_list;
-		
-		start = std::chrono::high_resolution_clock::now();
-		
-		for(int j = 0; j < MAX_ITERATIONS; j++ ){
-		
-			for(int i = 0; i < MAX_SIZE; i++){
-				regular_list.emplace_back(i);
-			}
-			
-			for(int i = 0; i < MAX_SIZE; i++){
-				regular_list.pop_front();
-			}
-			
-		}
-		
-		finish = std::chrono::high_resolution_clock::now();
-		
-		std::cout << "Time to alloc/free regular list of tests: " << std::chrono::duration_cast<std::chrono::milliseconds>(finish - start).count()  << "ms" << std::endl;
-		
-	}
-	
-	std::cout << "-----------------------------" << std::endl;
-	
 	{
 		std::list<Test, Allocator<Test, small_object_pool_policy<Test>>> pooled_list;
-		
-		start = std::chrono::high_resolution_clock::now();
-		
-		for(int j = 0; j < MAX_ITERATIONS; j++ ){
-			
-			for(int i = 0; i < MAX_SIZE; i++){
-				pooled_list.emplace_back(i);
-			}
-			
-			for(int i = 0; i < MAX_SIZE; i++){
-				pooled_list.pop_front();
-			}
-			
-		}
-		
-		finish = std::chrono::high_resolution_clock::now();
-		
-		std::cout << "Time to alloc/free pooled list of tests [small object]: " << std::chrono::duration_cast<std::chrono::milliseconds>(finish - start).count()  << "ms" << std::endl;
-		
+		for (int i = 0; i < MAX_SIZE; i++)
+			pooled_list.emplace_back(i);
 	}
-	
-	
-	std::cout << "-----------------------------" << std::endl;
 
 	{
-		std::list<Test, Allocator<Test, list_pool_policy<Test>>> pooled_list;
-
-		start = std::chrono::high_resolution_clock::now();
-
-		for (int j = 0; j < MAX_ITERATIONS; j++) {
-
-			for (int i = 0; i < MAX_SIZE; i++) {
-				pooled_list.emplace_back(i);
-			}
-
-			for (int i = 0; i < MAX_SIZE; i++) {
-				pooled_list.pop_front();
-			}
-
-		}
-
-		finish = std::chrono::high_resolution_clock::now();
-
-		std::cout << "Time to alloc/free pooled list of tests [list]: " << std::chrono::duration_cast<std::chrono::milliseconds>(finish - start).count() << "ms" << std::endl;
-
+		std::list<Thing, Allocator<Thing, list_pool_policy<Thing>>> pooled_list;
+		for (int i = 0; i < MAX_SIZE; i++)
+			pooled_list.emplace_back(i);
 	}
 
-	std::cout << "-----------------------------" << std::endl;
-
 	{
 		std::vector<Test, Allocator<Test, small_object_pool_policy<Test>>> pooled_vector;
+		for (int i = 0; i < MAX_SIZE; i++)
+			pooled_vector.emplace_back(i);
+	}
 
-		start = std::chrono::high_resolution_clock::now();
-
-		for (int j = 0; j < MAX_ITERATIONS; j++) {
-
-			for (int i = 0; i < MAX_SIZE; i++) {
-				pooled_vector.emplace_back(i);
-			}
-
-			for (int i = 0; i < MAX_SIZE; i++) {
-				pooled_vector.pop_back();
-			}
-
-		}
-
-		finish = std::chrono::high_resolution_clock::now();
+	// two lists on one set of pools of their own splice without copying a node
+	mem::PoolSet<> pools;
+	{
+		std::list<Thing, Allocator<Thing, pool_set_policy<Thing>>> first(pools), second(pools);
+		for (int i = 0; i < MAX_SIZE; i++)
+			second.emplace_back(i);
+		first.splice(first.end(), second);
+	}
 
-		std::cout << "Time to alloc/free pooled vector of tests [small object]: " << std::chrono::duration_cast<std::chrono::milliseconds>(finish - start).count() << "ms" << std::endl;
+	std::cout << mem::PoolRegistry::get().snapshot(mem::EXPORT_JSON);
 
-	}
-	
     return 0;
 }
@@ -0,0 +1,396 @@
+//
+//  Benchmark.hpp
+//  PoolAllocator
+//
+//  Copyright (c) 2017 Mike Allison. All rights reserved.
+//
+
+#pragma once
+
+//--------------------------------------------------------------------------------------------------
+// A small microbenchmark harness for objectpool_bench.  Every benchmark is a function that does a
+// fixed number of operations; it is run a few times untimed to warm up the pools and caches, then
+// timed for a number of repetitions, and each repetition becomes one sample in nanoseconds per
+// operation.  Results are printed as a table and can be written as CSV or JSON, one row per
+// benchmark with the summary statistics and the raw samples, so two versions can be diffed.
+//
+// Workloads draw their random numbers from fixed seeds, so every run does exactly the same work.
+//
+// Threaded benchmarks start all their threads before the clock starts, release them together and
+// stop the clock when the last one finishes; a sample is the wall time over the operations of all
+// threads.  The scaling table compares the throughput per thread at each thread count with the
+// throughput per thread at the smallest count run, 100% means perfectly linear scaling.
+//
+// With --counters every timed repetition is also counted with the hardware counters from
+// PerfCounters.hpp, and the totals are reported per operation next to the timings.
+//--------------------------------------------------------------------------------------------------
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "PerfCounters.hpp"
+
+namespace bench {
+
+	// keep the compiler from optimizing away work whose result is never read
+	template<typename T>
+	inline void do_not_optimize(T const& value) {
+#if defined(__GNUC__) || defined(__clang__)
+		asm volatile("" : : "r,m"(value) : "memory");
+#else
+		static volatile const void* sink;
+		sink = &value;
+#endif
+	}
+
+	struct Summary
+	{
+		double mean;
+		double median;
+		double stddev;
+		double min;
+		double max;
+	};
+
+	inline Summary summarize(std::vector<double> samples) {
+		Summary summary{ 0, 0, 0, 0, 0 };
+		if (samples.empty())
+			return summary;
+		std::sort(samples.begin(), samples.end());
+		double sum = 0;
+		for (double sample : samples)
+			sum += sample;
+		summary.mean = sum / samples.size();
+		size_t middle = samples.size() / 2;
+		summary.median = samples.size() % 2 ? samples[middle] : (samples[middle - 1] + samples[middle]) / 2;
+		double squares = 0;
+		for (double sample : samples)
+			squares += (sample - summary.mean) * (sample - summary.mean);
+		summary.stddev = samples.size() > 1 ? std::sqrt(squares / (samples.size() - 1)) : 0;
+		summary.min = samples.front();
+		summary.max = samples.back();
+		return summary;
+	}
+
+	struct Options
+	{
+		unsigned int warmup{ 2 };
+		unsigned int repetitions{ 10 };
+		double scale{ 1.0 };  // multiplies the operation count of every workload
+		std::string filter;  // only run benchmarks whose name contains this
+		bool scaling{ false };  // run the multithreaded benchmarks
+		bool counters{ false };  // count with the hardware performance counters
+		unsigned int maxThreads{ 0 };  // 0 for every hardware thread
+		std::string csvPath;
+		std::string jsonPath;
+	};
+
+	struct Result
+	{
+		std::string workload;
+		std::string policy;
+		unsigned int threads;
+		bool threaded;  // added with addThreaded()
+		size_t ops;  // over all threads
+		std::vector<double> samples;  // nanoseconds per operation, one per repetition
+		Summary summary;
+		CounterValues counters;  // summed over the repetitions
+
+		// a hardware counter per operation, or -1 if it wasn't counted
+		double perOp(unsigned int counter) const {
+			return counters.has(counter) && ops && !samples.empty() ? counters.values[counter] / ((double)ops * samples.size()) : -1;
+		}
+
+		std::string name() const { return workload + "/" + policy + (threaded ? "/" + std::to_string(threads) + "t" : ""); }
+
+		// the median, as operations per second over all threads
+		double opsPerSecond() const { return summary.median > 0 ? 1e9 / summary.median : 0; }
+	};
+
+	class Suite
+	{
+	public:
+
+		typedef std::function<void()> BenchFn;
+		typedef std::function<void(unsigned int thread)> ThreadFn;
+
+		explicit Suite(const Options& options) : mOptions(options) {}
+
+		const Options& getOptions() const { return mOptions; }
+
+		// how many operations a workload should do for a nominal count
+		size_t scaled(size_t ops) const { return std::max<size_t>(1, (size_t)(ops * mOptions.scale)); }
+
+		// fn does ops operations each time it is called
+		void add(const std::string& workload, const std::string& policy, size_t ops, const BenchFn& fn) {
+			mBenchmarks.push_back(Benchmark{ workload, policy, 1, ops, fn, nullptr });
+		}
+
+		// fn runs once on each of threads threads, told which one it is, and together they do ops operations
+		void addThreaded(const std::string& workload, const std::string& policy, unsigned int threads, size_t ops, const ThreadFn& fn) {
+			mBenchmarks.push_back(Benchmark{ workload, policy, threads, ops, nullptr, fn });
+		}
+
+		// 1, 2, 4 ... up to maxThreads, and maxThreads itself.  Never fewer than minThreads
+		std::vector<unsigned int> threadCounts(unsigned int minThreads = 1) const {
+			unsigned int maxThreads = mOptions.maxThreads ? mOptions.maxThreads : std::thread::hardware_concurrency();
+			maxThreads = std::max(maxThreads, minThreads);
+			std::vector<unsigned int> counts;
+			for (unsigned int count = minThreads; count < maxThreads; count *= 2)
+				counts.push_back(count);
+			counts.push_back(maxThreads);
+			return counts;
+		}
+
+		void run() {
+			mCountersOpen = false;
+			if (mOptions.counters) {
+				std::string error;
+				mCountersOpen = mPerfCounters.open(error);
+				if (!mCountersOpen)
+					std::cout << "hardware counters unavailable (" << error << "), timing only\n";
+			}
+
+			std::cout << std::left << std::setw(52) << "benchmark" << std::right << std::setw(12) << "ops"
+				<< std::setw(12) << "mean ns" << std::setw(12) << "median" << std::setw(10) << "stddev"
+				<< std::setw(10) << "min" << std::setw(10) << "max" << "\n";
+
+			for (auto& benchmark : mBenchmarks) {
+				Result result{ benchmark.workload, benchmark.policy, benchmark.threads, benchmark.threadFn != nullptr, benchmark.ops, {}, {}, {} };
+				if (!mOptions.filter.empty() && result.name().find(mOptions.filter) == std::string::npos)
+					continue;
+
+				for (unsigned int i = 0; i < mOptions.warmup; ++i)
+					time(benchmark, nullptr);
+
+				for (unsigned int i = 0; i < mOptions.repetitions; ++i)
+					result.samples.push_back(time(benchmark, mCountersOpen ? &result.counters : nullptr) / benchmark.ops);
+				result.summary = summarize(result.samples);
+				print(result);
+				mResults.push_back(result);
+			}
+
+			printScaling();
+
+			if (!mOptions.csvPath.empty())
+				writeFile(mOptions.csvPath, toCsv());
+			if (!mOptions.jsonPath.empty())
+				writeFile(mOptions.jsonPath, toJson());
+		}
+
+		const std::vector<Result>& getResults() const { return mResults; }
+
+		std::string toCsv() const {
+			std::ostringstream str;
+			str << "workload,policy,threads,ops,repetitions,ops_per_sec,mean_ns,median_ns,stddev_ns,min_ns,max_ns,";
+			for (unsigned int i = 0; i < NUM_COUNTERS; ++i)
+				str << counter_name(i) << "_per_op,";
+			str << "samples\n";
+			for (auto& result : mResults) {
+				str << result.workload << "," << result.policy << "," << result.threads << "," << result.ops << ","
+					<< result.samples.size() << "," << result.opsPerSecond() << "," << result.summary.mean << "," << result.summary.median << "," << result.summary.stddev
+					<< "," << result.summary.min << "," << result.summary.max << ",";
+				for (unsigned int i = 0; i < NUM_COUNTERS; ++i) {
+					if (result.counters.has(i))
+						str << result.perOp(i);
+					str << ",";
+				}
+				for (size_t i = 0; i < result.samples.size(); ++i)
+					str << (i ? ";" : "") << result.samples[i];
+				str << "\n";
+			}
+			return str.str();
+		}
+
+		std::string toJson() const {
+			std::ostringstream str;
+			str << "{\n  \"warmup\": " << mOptions.warmup << ",\n  \"repetitions\": " << mOptions.repetitions
+				<< ",\n  \"scale\": " << mOptions.scale << ",\n  \"benchmarks\": [\n";
+			for (size_t i = 0; i < mResults.size(); ++i) {
+				const Result& result = mResults[i];
+				str << "    {\"workload\": \"" << result.workload << "\", \"policy\": \"" << result.policy
+					<< "\", \"threads\": " << result.threads << ", \"ops\": " << result.ops
+					<< ", \"ops_per_sec\": " << result.opsPerSecond() << ", \"mean_ns\": " << result.summary.mean
+					<< ", \"median_ns\": " << result.summary.median << ", \"stddev_ns\": " << result.summary.stddev
+					<< ", \"min_ns\": " << result.summary.min << ", \"max_ns\": " << result.summary.max;
+				bool counted = false;
+				for (unsigned int j = 0; j < NUM_COUNTERS; ++j) {
+					if (!result.counters.has(j))
+						continue;
+					str << (counted ? ", \"" : ", \"counters_per_op\": {\"") << counter_name(j) << "\": " << result.perOp(j);
+					counted = true;
+				}
+				str << (counted ? "}" : "") << ", \"samples\": [";
+				for (size_t j = 0; j < result.samples.size(); ++j)
+					str << (j ? ", " : "") << result.samples[j];
+				str << "]}" << (i + 1 < mResults.size() ? "," : "") << "\n";
+			}
+			str << "  ]\n}\n";
+			return str.str();
+		}
+
+	private:
+
+		struct Benchmark {
+			std::string workload;
+			std::string policy;
+			unsigned int threads;
+			size_t ops;
+			BenchFn fn;
+			ThreadFn threadFn;
+		};
+
+		// one run in nanoseconds, adding what the hardware counters saw to counters if it isn't null
+		double time(const Benchmark& benchmark, CounterValues* counters) {
+			if (benchmark.fn) {
+				if (counters)
+					mPerfCounters.start();
+				auto start = std::chrono::steady_clock::now();
+				benchmark.fn();
+				auto finish = std::chrono::steady_clock::now();
+				if (counters)
+					counters->add(mPerfCounters.stop());
+				return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(finish - start).count();
+			}
+
+			// the counters only follow threads started after them, so they see the threads start and wait too
+			if (counters)
+				mPerfCounters.start();
+
+			std::atomic<bool> go{ false };
+			std::vector<std::chrono::steady_clock::time_point> finishes(benchmark.threads);
+			std::vector<std::thread> threads;
+			for (unsigned int i = 0; i < benchmark.threads; ++i) {
+				threads.emplace_back([&, i] {
+					while (!go.load(std::memory_order_acquire))
+						std::this_thread::yield();
+					benchmark.threadFn(i);
+					finishes[i] = std::chrono::steady_clock::now();
+				});
+			}
+			auto start = std::chrono::steady_clock::now();
+			go.store(true, std::memory_order_release);
+			for (auto& thread : threads)
+				thread.join();
+			if (counters)
+				counters->add(mPerfCounters.stop());
+			auto finish = *std::max_element(finishes.begin(), finishes.end());
+			return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(finish - start).count();
+		}
+
+		// throughput and efficiency of every threaded benchmark against its own smallest thread count
+		void printScaling() const {
+			bool header = false;
+			for (size_t i = 0; i < mResults.size(); ++i) {
+				const Result& base = mResults[i];
+				bool first = true;
+				for (size_t j = 0; j < i && first; ++j)
+					first = mResults[j].workload != base.workload || mResults[j].policy != base.policy;
+				if (!first || !base.threaded)
+					continue;
+
+				if (!header) {
+					std::cout << "\n" << std::left << std::setw(52) << "scaling" << std::right << std::setw(8) << "threads"
+						<< std::setw(16) << "ops/s" << std::setw(16) << "ops/s/thread" << std::setw(12) << "efficiency" << "\n";
+					header = true;
+				}
+				double basePerThread = base.opsPerSecond() / base.threads;
+				for (size_t j = i; j < mResults.size(); ++j) {
+					const Result& result = mResults[j];
+					if (result.workload != base.workload || result.policy != base.policy)
+						continue;
+					double perThread = result.opsPerSecond() / result.threads;
+					std::cout << std::left << std::setw(52) << (base.workload + "/" + base.policy) << std::right
+						<< std::setw(8) << result.threads << std::fixed << std::setprecision(0)
+						<< std::setw(16) << result.opsPerSecond() << std::setw(16) << perThread
+						<< std::setw(11) << (basePerThread > 0 ? 100 * perThread / basePerThread : 0) << "%" << std::endl;
+				}
+			}
+		}
+
+		static void print(const Result& result) {
+			std::cout << std::left << std::setw(52) << result.name() << std::right << std::setw(12) << result.ops
+				<< std::fixed << std::setprecision(2) << std::setw(12) << result.summary.mean
+				<< std::setw(12) << result.summary.median << std::setw(10) << result.summary.stddev
+				<< std::setw(10) << result.summary.min << std::setw(10) << result.summary.max << std::endl;
+
+			// per operation, on a line of its own under the timings
+			bool counted = false;
+			for (unsigned int i = 0; i < NUM_COUNTERS; ++i) {
+				if (!result.counters.has(i))
+					continue;
+				std::cout << (counted ? "  " : "    ") << counter_name(i) << " " << std::setprecision(3) << result.perOp(i);
+				counted = true;
+			}
+			if (result.counters.has(COUNTER_CYCLES) && result.counters.has(COUNTER_INSTRUCTIONS) && result.counters.values[COUNTER_CYCLES] > 0)
+				std::cout << "  ipc " << std::setprecision(2) << result.counters.values[COUNTER_INSTRUCTIONS] / result.counters.values[COUNTER_CYCLES];
+			if (counted)
+				std::cout << std::endl;
+		}
+
+		static void writeFile(const std::string& path, const std::string& text) {
+			std::ofstream file(path);
+			file << text;
+			if (!file)
+				std::cerr << "couldn't write " << path << std::endl;
+		}
+
+		Options mOptions;
+		std::vector<Benchmark> mBenchmarks;
+		std::vector<Result> mResults;
+		PerfCounters mPerfCounters;
+		bool mCountersOpen{ false };
+	};
+
+	// --warmup N --reps N --scale F --filter TEXT --csv PATH --json PATH --scaling --threads N --counters
+	inline bool parse_options(int argc, const char* argv[], Options& options) {
+		for (int i = 1; i < argc; ++i) {
+			std::string arg = argv[i];
+			if (arg == "--scaling" || arg == "--counters") {
+				(arg == "--scaling" ? options.scaling : options.counters) = true;
+				continue;
+			}
+			const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+			if (arg == "--help" || arg == "-h" || !value) {
+				std::cout << "usage: " << argv[0] << " [--warmup N] [--reps N] [--scale F] [--filter TEXT] [--csv PATH] [--json PATH]"
+					" [--scaling] [--threads N] [--counters]\n";
+				return false;
+			}
+			if (arg == "--warmup")
+				options.warmup = (unsigned int)atoi(value);
+			else if (arg == "--reps")
+				options.repetitions = std::max(1, atoi(value));
+			else if (arg == "--scale")
+				options.scale = atof(value);
+			else if (arg == "--filter")
+				options.filter = value;
+			else if (arg == "--csv")
+				options.csvPath = value;
+			else if (arg == "--json")
+				options.jsonPath = value;
+			else if (arg == "--threads")
+				options.maxThreads = (unsigned int)std::max(1, atoi(value));
+			else {
+				std::cerr << "unknown option " << arg << "\n";
+				return false;
+			}
+			++i;
+		}
+		return true;
+	}
+
+}
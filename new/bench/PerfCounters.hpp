@@ -0,0 +1,176 @@
+//
+//  PerfCounters.hpp
+//  objectpool_bench
+//
+//  Copyright (c) 2017 Mike Allison. All rights reserved.
+//
+
+#pragma once
+
+//--------------------------------------------------------------------------------------------------
+// Hardware performance counters around a benchmark, through Linux perf_event_open: cycles,
+// instructions, L1 data cache misses, last level cache misses, data TLB misses and branch misses.
+//
+// Every counter is opened on its own, so a machine without one of them still gets the rest, and
+// with inherit set so threads started while counting are counted too.  If the kernel runs more
+// counters than the CPU has registers they are multiplexed, and each value is scaled up by the
+// share of the time it was actually running.  Where perf_event_open doesn't exist or isn't allowed
+// (perf_event_paranoid, containers, other operating systems) open() fails, says why, and the
+// benchmarks run without counters.
+//--------------------------------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <string>
+#if defined(__linux__) && __has_include(<linux/perf_event.h>)
+#define BENCH_HAS_PERF_EVENTS 1
+#include <errno.h>
+#include <string.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#define BENCH_HAS_PERF_EVENTS 0
+#endif
+
+namespace bench {
+
+	enum Counter {
+		COUNTER_CYCLES,
+		COUNTER_INSTRUCTIONS,
+		COUNTER_L1D_MISSES,
+		COUNTER_LLC_MISSES,
+		COUNTER_DTLB_MISSES,
+		COUNTER_BRANCH_MISSES,
+		NUM_COUNTERS
+	};
+
+	inline const char* counter_name(unsigned int counter) {
+		static const char* sNames[NUM_COUNTERS] = { "cycles", "instructions", "l1d_misses", "llc_misses", "dtlb_misses", "branch_misses" };
+		return sNames[counter];
+	}
+
+	// what one measurement counted, a counter that couldn't be opened stays at -1
+	struct CounterValues
+	{
+		double values[NUM_COUNTERS];
+
+		CounterValues() { clear(); }
+
+		void clear() {
+			for (double& value : values)
+				value = -1;
+		}
+
+		bool has(unsigned int counter) const { return values[counter] >= 0; }
+
+		void add(const CounterValues& other) {
+			for (unsigned int i = 0; i < NUM_COUNTERS; ++i) {
+				if (other.has(i))
+					values[i] = (has(i) ? values[i] : 0) + other.values[i];
+			}
+		}
+	};
+
+	class PerfCounters
+	{
+	public:
+
+		PerfCounters() {
+			for (int& fd : mFds)
+				fd = -1;
+		}
+
+		~PerfCounters() { close(); }
+
+		PerfCounters(const PerfCounters&) = delete;
+		PerfCounters& operator=(const PerfCounters&) = delete;
+
+		// true if at least one counter opened, otherwise error says why
+		bool open(std::string& error) {
+#if BENCH_HAS_PERF_EVENTS
+			const uint32_t types[NUM_COUNTERS] = { PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+				PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE };
+			const uint64_t configs[NUM_COUNTERS] = {
+				PERF_COUNT_HW_CPU_CYCLES,
+				PERF_COUNT_HW_INSTRUCTIONS,
+				cacheMiss(PERF_COUNT_HW_CACHE_L1D),
+				cacheMiss(PERF_COUNT_HW_CACHE_LL),
+				cacheMiss(PERF_COUNT_HW_CACHE_DTLB),
+				PERF_COUNT_HW_BRANCH_MISSES
+			};
+
+			bool any = false;
+			for (unsigned int i = 0; i < NUM_COUNTERS; ++i) {
+				perf_event_attr attr;
+				memset(&attr, 0, sizeof(attr));
+				attr.size = sizeof(attr);
+				attr.type = types[i];
+				attr.config = configs[i];
+				attr.disabled = 1;
+				attr.inherit = 1;
+				attr.exclude_kernel = 1;
+				attr.exclude_hv = 1;
+				attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+				mFds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+				if (mFds[i] >= 0)
+					any = true;
+				else if (error.empty())
+					error = std::string("perf_event_open: ") + strerror(errno);
+			}
+			return any;
+#else
+			error = "perf_event_open isn't available on this platform";
+			return false;
+#endif
+		}
+
+		void close() {
+#if BENCH_HAS_PERF_EVENTS
+			for (int& fd : mFds) {
+				if (fd >= 0)
+					::close(fd);
+				fd = -1;
+			}
+#endif
+		}
+
+		void start() {
+#if BENCH_HAS_PERF_EVENTS
+			for (int fd : mFds) {
+				if (fd >= 0) {
+					ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+					ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+				}
+			}
+#endif
+		}
+
+		CounterValues stop() {
+			CounterValues result;
+#if BENCH_HAS_PERF_EVENTS
+			for (unsigned int i = 0; i < NUM_COUNTERS; ++i) {
+				if (mFds[i] < 0)
+					continue;
+				ioctl(mFds[i], PERF_EVENT_IOC_DISABLE, 0);
+				uint64_t values[3];  // value, time enabled, time running
+				if (read(mFds[i], values, sizeof(values)) != (ssize_t)sizeof(values))
+					continue;
+				result.values[i] = values[2] ? (double)values[0] * values[1] / values[2] : 0;
+			}
+#endif
+			return result;
+		}
+
+	private:
+
+#if BENCH_HAS_PERF_EVENTS
+		static uint64_t cacheMiss(uint64_t cache) {
+			return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		}
+#endif
+
+		int mFds[NUM_COUNTERS];
+	};
+
+}
@@ -0,0 +1,78 @@
+//
+//  Policies.hpp
+//  objectpool_bench
+//
+//  Copyright (c) 2017 Mike Allison. All rights reserved.
+//
+
+#pragma once
+
+//--------------------------------------------------------------------------------------------------
+// The allocation policies the benchmarks and the replay tool compare.  Each one is a tag holding a
+// template on the object type, so a workload written once can be instantiated for every policy.
+// The std::pmr workloads compare memory resources the same way, through tags that make one.
+//--------------------------------------------------------------------------------------------------
+
+#include <stddef.h>
+#include <memory>
+#include <memory_resource>
+#include "Allocator.hpp"
+#include "HeapPolicy.hpp"
+#include "ListPoolPolicy.hpp"
+#include "SmallObjectPoolPolicy.hpp"
+#include "NumaPoolPolicy.hpp"
+#include "PoolResource.hpp"
+#include "MonotonicArenaPolicy.hpp"
+
+struct heap
+{
+	template<typename T> using policy = heap_policy<T>;
+	constexpr static const char* NAME = "heap_policy";
+};
+
+struct list_pool
+{
+	template<typename T> using policy = list_pool_policy<T>;
+	constexpr static const char* NAME = "list_pool_policy";
+};
+
+struct small_object_pool
+{
+	template<typename T> using policy = small_object_pool_policy<T>;
+	constexpr static const char* NAME = "small_object_pool_policy";
+};
+
+struct numa_pool
+{
+	template<typename T> using policy = numa_pool_policy<T>;
+	constexpr static const char* NAME = "numa_pool_policy";
+};
+
+struct new_delete_resource
+{
+	constexpr static const char* NAME = "new_delete_resource";
+	static std::shared_ptr<std::pmr::memory_resource> make() {
+		return std::shared_ptr<std::pmr::memory_resource>(std::shared_ptr<void>(), std::pmr::new_delete_resource());
+	}
+};
+
+struct unsynchronized_pool_resource
+{
+	constexpr static const char* NAME = "unsynchronized_pool_resource";
+	static std::shared_ptr<std::pmr::memory_resource> make() { return std::make_shared<std::pmr::unsynchronized_pool_resource>(); }
+};
+
+struct pool_resource
+{
+	constexpr static const char* NAME = "mem::PoolResource";
+	static std::shared_ptr<std::pmr::memory_resource> make() { return std::make_shared<mem::PoolResource<>>(); }
+};
+
+template<typename T, typename PoliciesT>
+using allocator_of = Allocator<T, typename PoliciesT::template policy<T>>;
+
+// an object of size bytes
+template<size_t size>
+struct alignas(8) Blob {
+	char mBytes[size];
+};
@@ -0,0 +1,416 @@
+//
+//  main.cpp
+//  objectpool_bench
+//
+//  Copyright (c) 2017 Mike Allison. All rights reserved.
+//
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <map>
+#include <memory_resource>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Benchmark.hpp"
+#include "Policies.hpp"
+
+// Every workload is timed per operation, where an operation is one allocation or one free (one
+// insert or one erase for the containers).  Sequences are drawn up front from fixed seeds so the
+// random number generator stays out of the timings and every run does the same work.
+
+const size_t NUM_OBJECTS = 5000;
+const size_t NUM_ROUNDS = 20;
+const size_t THREAD_OBJECTS = 1000;  // the working set of each thread in the scaling benchmarks
+const size_t THREAD_ROUNDS = 50;
+
+struct Object {
+	int mVal;
+	int mAnother;
+	float mYetAnother;
+};
+
+std::vector<size_t> shuffled(size_t count, uint32_t seed) {
+	std::vector<size_t> order(count);
+	for (size_t i = 0; i < count; ++i)
+		order[i] = i;
+	std::shuffle(order.begin(), order.end(), std::mt19937(seed));
+	return order;
+}
+
+template<typename PoliciesT>
+void add_object_workloads(bench::Suite& suite) {
+	size_t rounds = suite.scaled(NUM_ROUNDS);
+
+	// a stack that grows and shrinks at random, every free is the most recent allocation
+	{
+		std::mt19937 random(1);
+		std::vector<bool> pushes;
+		size_t depth = 0;
+		for (size_t i = 0; i < NUM_OBJECTS * rounds; ++i) {
+			bool push = depth == 0 || (depth < NUM_OBJECTS && random() % 2);
+			depth += push ? 1 : -1;
+			pushes.push_back(push);
+		}
+		pushes.insert(pushes.end(), depth, false);
+
+		suite.add("lifo_churn", PoliciesT::NAME, pushes.size(), [pushes] {
+			allocator_of<Object, PoliciesT> allocator;
+			std::vector<Object*> stack;
+			stack.reserve(NUM_OBJECTS);
+			for (bool push : pushes) {
+				if (push) {
+					stack.push_back(allocator.allocate(1));
+					stack.back()->mVal = 0;
+				}
+				else {
+					allocator.deallocate(stack.back(), 1);
+					stack.pop_back();
+				}
+			}
+			bench::do_not_optimize(stack);
+		});
+	}
+
+	// objects are freed in the order they were allocated
+	suite.add("fifo", PoliciesT::NAME, 2 * NUM_OBJECTS * rounds, [rounds] {
+		allocator_of<Object, PoliciesT> allocator;
+		std::vector<Object*> objects(NUM_OBJECTS);
+		for (size_t round = 0; round < rounds; ++round) {
+			for (auto& object : objects) {
+				object = allocator.allocate(1);
+				object->mVal = 0;
+			}
+			for (auto object : objects)
+				allocator.deallocate(object, 1);
+		}
+		bench::do_not_optimize(objects);
+	});
+
+	// objects are freed in random order, which scatters the free list
+	{
+		std::vector<size_t> order = shuffled(NUM_OBJECTS, 2);
+		suite.add("random_free", PoliciesT::NAME, 2 * NUM_OBJECTS * rounds, [order, rounds] {
+			allocator_of<Object, PoliciesT> allocator;
+			std::vector<Object*> objects(NUM_OBJECTS);
+			for (size_t round = 0; round < rounds; ++round) {
+				for (auto& object : objects) {
+					object = allocator.allocate(1);
+					object->mVal = 0;
+				}
+				for (size_t index : order)
+					allocator.deallocate(objects[index], 1);
+			}
+			bench::do_not_optimize(objects);
+		});
+	}
+
+	// four object sizes interleaved at random and freed in random order
+	{
+		std::mt19937 random(3);
+		std::vector<unsigned char> sizes(NUM_OBJECTS);
+		for (auto& size : sizes)
+			size = (unsigned char)(random() % 4);
+		std::vector<size_t> order = shuffled(NUM_OBJECTS, 4);
+
+		suite.add("mixed_sizes", PoliciesT::NAME, 2 * NUM_OBJECTS * rounds, [sizes, order, rounds] {
+			allocator_of<Blob<16>, PoliciesT> small;
+			allocator_of<Blob<48>, PoliciesT> medium;
+			allocator_of<Blob<128>, PoliciesT> large;
+			allocator_of<Blob<256>, PoliciesT> huge;
+			std::vector<void*> objects(NUM_OBJECTS);
+			for (size_t round = 0; round < rounds; ++round) {
+				for (size_t i = 0; i < NUM_OBJECTS; ++i) {
+					switch (sizes[i]) {
+					case 0: objects[i] = small.allocate(1); break;
+					case 1: objects[i] = medium.allocate(1); break;
+					case 2: objects[i] = large.allocate(1); break;
+					default: objects[i] = huge.allocate(1); break;
+					}
+					*(char*)objects[i] = 0;
+				}
+				for (size_t index : order) {
+					switch (sizes[index]) {
+					case 0: small.deallocate((Blob<16>*)objects[index], 1); break;
+					case 1: medium.deallocate((Blob<48>*)objects[index], 1); break;
+					case 2: large.deallocate((Blob<128>*)objects[index], 1); break;
+					default: huge.deallocate((Blob<256>*)objects[index], 1); break;
+					}
+				}
+			}
+			bench::do_not_optimize(objects);
+		});
+	}
+}
+
+// hands pointers from one thread to another, a bounded single producer single consumer ring
+class Handoff
+{
+public:
+
+	void push(void* ptr) {
+		size_t tail = mTail.load(std::memory_order_relaxed);
+		while (tail - mHead.load(std::memory_order_acquire) == CAPACITY)
+			std::this_thread::yield();
+		mSlots[tail % CAPACITY] = ptr;
+		mTail.store(tail + 1, std::memory_order_release);
+	}
+
+	void* pop() {
+		size_t head = mHead.load(std::memory_order_relaxed);
+		while (mTail.load(std::memory_order_acquire) == head)
+			std::this_thread::yield();
+		void* ptr = mSlots[head % CAPACITY];
+		mHead.store(head + 1, std::memory_order_release);
+		return ptr;
+	}
+
+private:
+
+	constexpr static const size_t CAPACITY = 1024;
+
+	alignas(64) std::atomic<size_t> mHead{ 0 };
+	alignas(64) std::atomic<size_t> mTail{ 0 };
+	void* mSlots[CAPACITY];
+};
+
+template<typename PoliciesT>
+void add_scaling_workloads(bench::Suite& suite) {
+	size_t rounds = suite.scaled(THREAD_ROUNDS);
+	size_t threadOps = 2 * THREAD_OBJECTS * rounds;
+
+	// every thread allocates a working set and frees it in random order, touching nobody else's objects
+	std::vector<size_t> order = shuffled(THREAD_OBJECTS, 7);
+	for (unsigned int threads : suite.threadCounts()) {
+		suite.addThreaded("local", PoliciesT::NAME, threads, threads * threadOps, [order, rounds](unsigned int) {
+			allocator_of<Object, PoliciesT> allocator;
+			std::vector<Object*> objects(THREAD_OBJECTS);
+			for (size_t round = 0; round < rounds; ++round) {
+				for (auto& object : objects) {
+					object = allocator.allocate(1);
+					object->mVal = 0;
+				}
+				for (size_t index : order)
+					allocator.deallocate(objects[index], 1);
+			}
+			bench::do_not_optimize(objects);
+		});
+	}
+
+	// threads pair up, the even one allocates and hands every object to the odd one, which frees it
+	for (unsigned int threads : suite.threadCounts(2)) {
+		if (threads % 2)
+			continue;
+		unsigned int pairs = threads / 2;
+		std::shared_ptr<Handoff[]> handoffs(new Handoff[pairs]);
+		suite.addThreaded("producer_consumer", PoliciesT::NAME, threads, pairs * threadOps, [handoffs, threadOps](unsigned int thread) {
+			allocator_of<Object, PoliciesT> allocator;
+			Handoff& handoff = handoffs[thread / 2];
+			if (thread % 2 == 0) {
+				for (size_t i = 0; i < threadOps / 2; ++i) {
+					Object* object = allocator.allocate(1);
+					object->mVal = 0;
+					handoff.push(object);
+				}
+			}
+			else {
+				for (size_t i = 0; i < threadOps / 2; ++i)
+					allocator.deallocate((Object*)handoff.pop(), 1);
+			}
+		});
+	}
+}
+
+template<typename PoliciesT>
+void add_container_workloads(bench::Suite& suite) {
+	size_t rounds = suite.scaled(NUM_ROUNDS);
+	std::vector<size_t> keys = shuffled(NUM_OBJECTS, 5);
+	std::vector<size_t> eraseOrder = shuffled(NUM_OBJECTS, 6);
+
+	// the workload main.cpp used to time: fill a list at the back and empty it from the front
+	suite.add("list", PoliciesT::NAME, 2 * NUM_OBJECTS * rounds, [rounds] {
+		std::list<Object, allocator_of<Object, PoliciesT>> list;
+		for (size_t round = 0; round < rounds; ++round) {
+			for (size_t i = 0; i < NUM_OBJECTS; ++i)
+				list.push_back(Object{ (int)i, 0, 0 });
+			for (size_t i = 0; i < NUM_OBJECTS; ++i)
+				list.pop_front();
+		}
+		bench::do_not_optimize(list);
+	});
+
+	suite.add("map", PoliciesT::NAME, 2 * NUM_OBJECTS * rounds, [keys, eraseOrder, rounds] {
+		typedef std::pair<const size_t, Object> value_type;
+		std::map<size_t, Object, std::less<size_t>, allocator_of<value_type, PoliciesT>> map;
+		for (size_t round = 0; round < rounds; ++round) {
+			for (size_t key : keys)
+				map.emplace(key, Object{ 0, 0, 0 });
+			for (size_t key : eraseOrder)
+				map.erase(key);
+		}
+		bench::do_not_optimize(map);
+	});
+
+	// the bucket arrays and the vector's storage are multi-object allocations
+	suite.add("unordered_map", PoliciesT::NAME, 2 * NUM_OBJECTS * rounds, [keys, eraseOrder, rounds] {
+		typedef std::pair<const size_t, Object> value_type;
+		std::unordered_map<size_t, Object, std::hash<size_t>, std::equal_to<size_t>, allocator_of<value_type, PoliciesT>> map;
+		for (size_t round = 0; round < rounds; ++round) {
+			for (size_t key : keys)
+				map.emplace(key, Object{ 0, 0, 0 });
+			for (size_t key : eraseOrder)
+				map.erase(key);
+		}
+		bench::do_not_optimize(map);
+	});
+
+	// a fresh vector every round so it goes through all its reallocations
+	suite.add("vector", PoliciesT::NAME, NUM_OBJECTS * rounds, [rounds] {
+		for (size_t round = 0; round < rounds; ++round) {
+			std::vector<Object, allocator_of<Object, PoliciesT>> vector;
+			for (size_t i = 0; i < NUM_OBJECTS; ++i)
+				vector.push_back(Object{ (int)i, 0, 0 });
+			bench::do_not_optimize(vector);
+		}
+	});
+}
+
+// a list and a map built up and thrown away whole, once per frame, with endFrame() run after each
+// frame is gone
+template<typename AllocatorT, typename EndFrameT>
+void add_frame_workloads(bench::Suite& suite, const char* policy, const AllocatorT& allocator, EndFrameT endFrame) {
+	size_t rounds = suite.scaled(NUM_ROUNDS);
+	std::vector<size_t> keys = shuffled(NUM_OBJECTS, 7);
+
+	suite.add("frame_list", policy, 2 * NUM_OBJECTS * rounds, [allocator, endFrame, rounds] {
+		for (size_t round = 0; round < rounds; ++round) {
+			{
+				std::list<Object, AllocatorT> list(allocator);
+				for (size_t i = 0; i < NUM_OBJECTS; ++i)
+					list.push_back(Object{ (int)i, 0, 0 });
+				bench::do_not_optimize(list);
+			}
+			endFrame();
+		}
+	});
+
+	typedef typename std::allocator_traits<AllocatorT>::template rebind_alloc<std::pair<const size_t, Object>> MapAllocatorT;
+	suite.add("frame_map", policy, 2 * NUM_OBJECTS * rounds, [allocator, endFrame, keys, rounds] {
+		for (size_t round = 0; round < rounds; ++round) {
+			{
+				std::map<size_t, Object, std::less<size_t>, MapAllocatorT> map{ MapAllocatorT(allocator) };
+				for (size_t key : keys)
+					map.emplace(key, Object{ 0, 0, 0 });
+				bench::do_not_optimize(map);
+			}
+			endFrame();
+		}
+	});
+}
+
+// the container workloads again on std::pmr containers.  Every workload keeps one resource for all
+// its repetitions, the way the policies keep their pools
+template<typename ResourceT>
+void add_pmr_workloads(bench::Suite& suite) {
+	size_t rounds = suite.scaled(NUM_ROUNDS);
+	std::vector<size_t> keys = shuffled(NUM_OBJECTS, 5);
+	std::vector<size_t> eraseOrder = shuffled(NUM_OBJECTS, 6);
+
+	std::shared_ptr<std::pmr::memory_resource> resource = ResourceT::make();
+	suite.add("pmr_list", ResourceT::NAME, 2 * NUM_OBJECTS * rounds, [resource, rounds] {
+		std::pmr::list<Object> list(resource.get());
+		for (size_t round = 0; round < rounds; ++round) {
+			for (size_t i = 0; i < NUM_OBJECTS; ++i)
+				list.push_back(Object{ (int)i, 0, 0 });
+			for (size_t i = 0; i < NUM_OBJECTS; ++i)
+				list.pop_front();
+		}
+		bench::do_not_optimize(list);
+	});
+
+	resource = ResourceT::make();
+	suite.add("pmr_map", ResourceT::NAME, 2 * NUM_OBJECTS * rounds, [resource, keys, eraseOrder, rounds] {
+		std::pmr::map<size_t, Object> map(resource.get());
+		for (size_t round = 0; round < rounds; ++round) {
+			for (size_t key : keys)
+				map.emplace(key, Object{ 0, 0, 0 });
+			for (size_t key : eraseOrder)
+				map.erase(key);
+		}
+		bench::do_not_optimize(map);
+	});
+
+	resource = ResourceT::make();
+	suite.add("pmr_unordered_map", ResourceT::NAME, 2 * NUM_OBJECTS * rounds, [resource, keys, eraseOrder, rounds] {
+		std::pmr::unordered_map<size_t, Object> map(resource.get());
+		for (size_t round = 0; round < rounds; ++round) {
+			for (size_t key : keys)
+				map.emplace(key, Object{ 0, 0, 0 });
+			for (size_t key : eraseOrder)
+				map.erase(key);
+		}
+		bench::do_not_optimize(map);
+	});
+
+	// short vectors and strings that outgrow the small string buffer, one allocation per reserve
+	resource = ResourceT::make();
+	suite.add("pmr_small_arrays", ResourceT::NAME, 2 * NUM_OBJECTS * rounds, [resource, rounds] {
+		for (size_t round = 0; round < rounds; ++round) {
+			std::pmr::vector<std::pmr::string> strings(resource.get());
+			strings.reserve(NUM_OBJECTS / 2);
+			for (size_t i = 0; i < NUM_OBJECTS / 2; ++i)
+				strings.emplace_back(16 + i % 64, 'x');
+			std::pmr::vector<std::pmr::vector<int>> vectors(resource.get());
+			vectors.reserve(NUM_OBJECTS / 2);
+			for (size_t i = 0; i < NUM_OBJECTS / 2; ++i)
+				vectors.emplace_back(1 + i % 32, (int)i);
+			bench::do_not_optimize(strings);
+			bench::do_not_optimize(vectors);
+		}
+	});
+}
+
+int main(int argc, const char* argv[]) {
+	bench::Options options;
+	if (!bench::parse_options(argc, argv, options))
+		return 1;
+
+	bench::Suite suite(options);
+
+	if (options.scaling) {
+		add_scaling_workloads<heap>(suite);
+		add_scaling_workloads<list_pool>(suite);
+		add_scaling_workloads<small_object_pool>(suite);
+		add_scaling_workloads<numa_pool>(suite);
+		suite.run();
+		return 0;
+	}
+
+	add_object_workloads<heap>(suite);
+	add_object_workloads<list_pool>(suite);
+	add_object_workloads<small_object_pool>(suite);
+
+	add_container_workloads<heap>(suite);
+	add_container_workloads<list_pool>(suite);
+	add_container_workloads<small_object_pool>(suite);
+
+	add_frame_workloads(suite, heap::NAME, allocator_of<Object, heap>(), [] {});
+	add_frame_workloads(suite, list_pool::NAME, allocator_of<Object, list_pool>(), [] {});
+	add_frame_workloads(suite, small_object_pool::NAME, allocator_of<Object, small_object_pool>(), [] {});
+	std::shared_ptr<mem::MonotonicArena<>> arena = std::make_shared<mem::MonotonicArena<>>();
+	add_frame_workloads(suite, "monotonic_arena_policy", Allocator<Object, monotonic_arena_policy<Object>>(*arena), [arena] { arena->reset(); });
+
+	add_pmr_workloads<new_delete_resource>(suite);
+	add_pmr_workloads<unsynchronized_pool_resource>(suite);
+	add_pmr_workloads<pool_resource>(suite);
+
+	suite.run();
+	return 0;
+}
@@ -0,0 +1,305 @@
+//
+//  replay.cpp
+//  objectpool_replay
+//
+//  Copyright (c) 2017 Mike Allison. All rights reserved.
+//
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#if defined(__linux__)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "AllocationTrace.hpp"
+#include "Policies.hpp"
+
+// Replays a trace written by mem::AllocationTrace against every policy and reports how long it
+// took, the peak RSS it caused and how much of that peak was not live objects.
+//
+// Allocations are replayed in the trace's global order on one thread.  A single object of up to
+// MAX_POOLED_SIZE bytes becomes a Blob of its size rounded up to 8 bytes, so every policy pools it
+// by size the way it would pool the original type; anything bigger, and arrays, are allocated as
+// arrays of Blob<8>.  Alignments above 8 are not reproduced.
+//
+// Each policy is replayed in a child process of its own so its peak RSS isn't muddled by the
+// others.  Fragmentation is the share of the peak RSS growth not taken up by the bytes that were
+// live at the peak: 1 - peak live bytes / (peak RSS - RSS before the replay).
+
+const size_t MAX_POOLED_SIZE = 256;
+const size_t SIZE_STEP = 8;
+const size_t NUM_SIZES = MAX_POOLED_SIZE / SIZE_STEP;
+
+// one step of the replay, with the object's address turned into a slot
+struct ReplayOp
+{
+	bool alloc;
+	unsigned char size;  // the Blob index for pooled objects, NUM_SIZES for arrays
+	uint32_t slot;
+	uint32_t units;  // Blob<8>s in an array
+};
+
+struct Replay
+{
+	std::vector<ReplayOp> ops;
+	size_t numSlots;
+	size_t peakLiveBytes;
+};
+
+struct ReplayResult
+{
+	double seconds;  // the fastest repetition
+	uint64_t baseRssKb;
+	uint64_t peakRssKb;
+};
+
+// turns addresses into dense slots, a freed address is a new object the next time it comes back
+Replay compile(const std::vector<mem::TraceEvent>& events) {
+	Replay replay{ {}, 0, 0 };
+	std::unordered_map<uint64_t, std::pair<uint32_t, size_t>> live;  // address -> slot, bytes
+	std::vector<uint32_t> freeSlots;
+	size_t liveBytes = 0;
+	for (const mem::TraceEvent& event : events) {
+		size_t bytes = event.size * event.count;
+		ReplayOp op;
+		op.alloc = event.op == mem::TRACE_ALLOC;
+		op.size = (unsigned char)(event.count == 1 && bytes <= MAX_POOLED_SIZE ? (std::max<size_t>(bytes, 1) - 1) / SIZE_STEP : NUM_SIZES);
+		op.units = (uint32_t)((bytes + SIZE_STEP - 1) / SIZE_STEP);
+
+		if (op.alloc) {
+			if (freeSlots.empty()) {
+				freeSlots.push_back((uint32_t)replay.numSlots++);
+			}
+			op.slot = freeSlots.back();
+			freeSlots.pop_back();
+			live[event.object] = std::make_pair(op.slot, bytes);
+			liveBytes += bytes;
+			replay.peakLiveBytes = std::max(replay.peakLiveBytes, liveBytes);
+		}
+		else {
+			// allocated before the trace started
+			auto it = live.find(event.object);
+			if (it == live.end())
+				continue;
+			op.slot = it->second.first;
+			liveBytes -= it->second.second;
+			freeSlots.push_back(op.slot);
+			live.erase(it);
+		}
+		replay.ops.push_back(op);
+	}
+	return replay;
+}
+
+// Linux reports both in /proc/self/status, elsewhere we have neither
+uint64_t status_kb(const char* field) {
+	std::ifstream status("/proc/self/status");
+	std::string line;
+	size_t length = strlen(field);
+	while (std::getline(status, line)) {
+		if (line.compare(0, length, field) == 0 && line.size() > length && line[length] == ':')
+			return strtoull(line.c_str() + length + 1, nullptr, 10);
+	}
+	return 0;
+}
+
+template<typename PoliciesT>
+class Replayer
+{
+public:
+
+	static ReplayResult run(const Replay& replay, unsigned int repetitions) {
+		std::vector<void*> slots(replay.numSlots, nullptr);
+		std::vector<const ReplayOp*> allocs(replay.numSlots, nullptr);  // what each slot holds
+		ReplayResult result{ 0, status_kb("VmRSS"), 0 };
+
+		for (unsigned int i = 0; i < repetitions; ++i) {
+			auto start = std::chrono::steady_clock::now();
+			for (const ReplayOp& op : replay.ops) {
+				if (op.alloc) {
+					void* ptr = op.size < NUM_SIZES ? sAllocs[op.size]() : allocArray(op.units);
+					*(char*)ptr = 0;
+					slots[op.slot] = ptr;
+					allocs[op.slot] = &op;
+				}
+				else {
+					if (op.size < NUM_SIZES)
+						sFrees[op.size](slots[op.slot]);
+					else
+						freeArray(slots[op.slot], op.units);
+					slots[op.slot] = nullptr;
+				}
+			}
+			auto finish = std::chrono::steady_clock::now();
+			double seconds = std::chrono::duration<double>(finish - start).count();
+			result.seconds = i ? std::min(result.seconds, seconds) : seconds;
+
+			// whatever was still live when the trace ended
+			for (size_t slot = 0; slot < slots.size(); ++slot) {
+				if (!slots[slot])
+					continue;
+				if (allocs[slot]->size < NUM_SIZES)
+					sFrees[allocs[slot]->size](slots[slot]);
+				else
+					freeArray(slots[slot], allocs[slot]->units);
+				slots[slot] = nullptr;
+			}
+		}
+		result.peakRssKb = status_kb("VmHWM");
+		return result;
+	}
+
+private:
+
+	typedef void* (*AllocFn)();
+	typedef void (*FreeFn)(void*);
+
+	template<size_t size>
+	static void* alloc() {
+		allocator_of<Blob<size>, PoliciesT> allocator;
+		return allocator.allocate(1);
+	}
+
+	template<size_t size>
+	static void free(void* ptr) {
+		allocator_of<Blob<size>, PoliciesT> allocator;
+		allocator.deallocate((Blob<size>*)ptr, 1);
+	}
+
+	static void* allocArray(uint32_t units) {
+		return allocator_of<Blob<SIZE_STEP>, PoliciesT>().allocate(units);
+	}
+
+	static void freeArray(void* ptr, uint32_t units) {
+		allocator_of<Blob<SIZE_STEP>, PoliciesT>().deallocate((Blob<SIZE_STEP>*)ptr, units);
+	}
+
+	template<size_t...indices>
+	constexpr static std::array<AllocFn, NUM_SIZES> allocTable(std::index_sequence<indices...>) { return { { &alloc<(indices + 1) * SIZE_STEP>... } }; }
+
+	template<size_t...indices>
+	constexpr static std::array<FreeFn, NUM_SIZES> freeTable(std::index_sequence<indices...>) { return { { &free<(indices + 1) * SIZE_STEP>... } }; }
+
+	constexpr static const std::array<AllocFn, NUM_SIZES> sAllocs = allocTable(std::make_index_sequence<NUM_SIZES>());
+	constexpr static const std::array<FreeFn, NUM_SIZES> sFrees = freeTable(std::make_index_sequence<NUM_SIZES>());
+};
+
+// in a child process where there is fork(), so every policy starts from the same RSS
+template<typename PoliciesT>
+bool replay_isolated(const Replay& replay, unsigned int repetitions, ReplayResult& result) {
+#if defined(__linux__)
+	int fds[2];
+	if (pipe(fds) == 0) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			close(fds[0]);
+			result = Replayer<PoliciesT>::run(replay, repetitions);
+			bool ok = write(fds[1], &result, sizeof(result)) == (ssize_t)sizeof(result);
+			_exit(ok ? 0 : 1);
+		}
+		close(fds[1]);
+		bool ok = pid > 0 && read(fds[0], &result, sizeof(result)) == (ssize_t)sizeof(result);
+		close(fds[0]);
+		int status = 0;
+		if (pid > 0)
+			waitpid(pid, &status, 0);
+		return ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	}
+#endif
+	result = Replayer<PoliciesT>::run(replay, repetitions);
+	return true;
+}
+
+template<typename PoliciesT>
+void replay_policy(const Replay& replay, unsigned int repetitions, const std::string& filter) {
+	if (!filter.empty() && std::string(PoliciesT::NAME).find(filter) == std::string::npos)
+		return;
+	ReplayResult result;
+	if (!replay_isolated<PoliciesT>(replay, repetitions, result)) {
+		std::cout << std::left << std::setw(28) << PoliciesT::NAME << "replay failed" << std::endl;
+		return;
+	}
+	double growth = (double)(result.peakRssKb > result.baseRssKb ? result.peakRssKb - result.baseRssKb : 0) * 1024;
+	double fragmentation = growth > replay.peakLiveBytes ? 1 - replay.peakLiveBytes / growth : 0;
+	std::cout << std::left << std::setw(28) << PoliciesT::NAME << std::right << std::fixed
+		<< std::setprecision(3) << std::setw(12) << result.seconds * 1e3
+		<< std::setprecision(1) << std::setw(12) << result.seconds * 1e9 / std::max<size_t>(1, replay.ops.size())
+		<< std::setw(14) << result.peakRssKb << std::setw(14) << (uint64_t)(growth / 1024)
+		<< std::setprecision(3) << std::setw(16) << fragmentation << std::endl;
+}
+
+int main(int argc, const char* argv[]) {
+	std::string path;
+	std::string filter;
+	unsigned int repetitions = 1;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--reps" && i + 1 < argc)
+			repetitions = (unsigned int)std::max(1, atoi(argv[++i]));
+		else if (arg == "--filter" && i + 1 < argc)
+			filter = argv[++i];
+		else if (arg[0] != '-' && path.empty())
+			path = arg;
+		else
+			path.clear(), i = argc;
+	}
+	if (path.empty()) {
+		std::cout << "usage: " << argv[0] << " TRACE [--reps N] [--filter POLICY]\n";
+		return 1;
+	}
+
+	std::vector<mem::TraceEvent> events;
+	std::vector<std::string> policyNames;
+	if (!mem::AllocationTrace::read(path, events, policyNames)) {
+		std::cerr << "couldn't read all of " << path << (events.empty() ? "" : ", replaying what could be read") << std::endl;
+		if (events.empty())
+			return 1;
+	}
+
+	std::vector<uint64_t> policyAllocs(policyNames.size(), 0);
+	uint32_t threads = 0;
+	for (const mem::TraceEvent& event : events) {
+		threads = std::max(threads, event.thread + 1);
+		if (event.op == mem::TRACE_ALLOC && event.policy < policyAllocs.size())
+			++policyAllocs[event.policy];
+	}
+
+	Replay replay = compile(events);
+	uint64_t duration = events.empty() ? 0 : events.back().time;
+	size_t numEvents = events.size();
+
+	// hand the trace's memory back to the system, or the replays would grow into it without a trace in RSS
+	std::vector<mem::TraceEvent>().swap(events);
+#if defined(__GLIBC__)
+	malloc_trim(0);
+#endif
+
+	std::cout << path << ": " << numEvents << " events over " << duration / 1e6
+		<< " ms from " << threads << " threads, " << replay.peakLiveBytes << " bytes live at the peak\n";
+	for (size_t i = 0; i < policyNames.size(); ++i)
+		std::cout << "  " << std::setw(10) << policyAllocs[i] << " allocs through " << policyNames[i] << "\n";
+	std::cout << "\n" << std::left << std::setw(28) << "policy" << std::right << std::setw(12) << "ms"
+		<< std::setw(12) << "ns/event" << std::setw(14) << "peak RSS KB" << std::setw(14) << "growth KB"
+		<< std::setw(16) << "fragmentation" << "\n";
+
+	replay_policy<heap>(replay, repetitions, filter);
+	replay_policy<list_pool>(replay, repetitions, filter);
+	replay_policy<small_object_pool>(replay, repetitions, filter);
+	return 0;
+}
@@ -0,0 +1,171 @@
+#include "catch.hpp"
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+#include "Allocator.hpp"
+#include "ListPoolPolicy.hpp"
+#include "AllocationTrace.hpp"
+
+#ifndef MEM_TRACE_ALLOCATIONS
+#error "the tests are built with MEM_TRACE_ALLOCATIONS, see CMakeLists.txt"
+#endif
+
+namespace {
+
+	struct Traced { unsigned char bytes[24]; };
+	struct TracedArray { double values[2]; };
+
+	typedef list_pool_policy<Traced> TracedPolicy;
+	typedef heap_policy<TracedArray> TracedArrayPolicy;
+
+	struct Expected {
+		mem::TraceOp op;
+		const void* object;
+		size_t size;
+		size_t count;
+		size_t alignment;
+	};
+
+}
+
+TEST_CASE( "AllocationTrace records what goes through an Allocator", "[AllocationTrace]" ) {
+	std::string path = "allocation_trace_test.trace";
+	Allocator<Traced, TracedPolicy> allocator;
+	Allocator<TracedArray, TracedArrayPolicy> arrayAllocator;
+
+	// nothing is recorded before the trace starts
+	Traced* before = allocator.allocate(1);
+
+	REQUIRE(mem::AllocationTrace::get().start(path));
+	Traced* first = allocator.allocate(1);
+	Traced* second = allocator.allocate(1);
+	TracedArray* array = arrayAllocator.allocate(3);
+	allocator.deallocate(first, 1);
+	arrayAllocator.deallocate(array, 3);
+	allocator.deallocate(before, 1);
+	Traced* other = nullptr;
+	std::thread([&] { other = allocator.allocate(1); }).join();
+	allocator.deallocate(other, 1);
+	allocator.deallocate(second, 1);
+	REQUIRE(mem::AllocationTrace::get().stop() == 9);
+
+	// and nothing after it stops
+	allocator.deallocate(allocator.allocate(1), 1);
+
+	std::vector<mem::TraceEvent> events;
+	std::vector<std::string> policyNames;
+	REQUIRE(mem::AllocationTrace::read(path, events, policyNames));
+	std::remove(path.c_str());
+
+	std::vector<Expected> expected = {
+		{ mem::TRACE_ALLOC, first, sizeof(Traced), 1, alignof(Traced) },
+		{ mem::TRACE_ALLOC, second, sizeof(Traced), 1, alignof(Traced) },
+		{ mem::TRACE_ALLOC, array, sizeof(TracedArray), 3, alignof(TracedArray) },
+		{ mem::TRACE_FREE, first, sizeof(Traced), 1, alignof(Traced) },
+		{ mem::TRACE_FREE, array, sizeof(TracedArray), 3, alignof(TracedArray) },
+		{ mem::TRACE_FREE, before, sizeof(Traced), 1, alignof(Traced) },
+		{ mem::TRACE_ALLOC, other, sizeof(Traced), 1, alignof(Traced) },
+		{ mem::TRACE_FREE, other, sizeof(Traced), 1, alignof(Traced) },
+		{ mem::TRACE_FREE, second, sizeof(Traced), 1, alignof(Traced) },
+	};
+	REQUIRE(events.size() == expected.size());
+
+	// the addresses come back whole after going through the zigzagged deltas, whichever way they went
+	bool wentUp = false, wentDown = false;
+	for (size_t i = 0; i < events.size(); ++i) {
+		INFO("event " << i);
+		REQUIRE(events[i].op == expected[i].op);
+		REQUIRE(events[i].object == (uint64_t)(uintptr_t)expected[i].object);
+		REQUIRE(events[i].size == expected[i].size);
+		REQUIRE(events[i].count == expected[i].count);
+		REQUIRE(events[i].alignment == expected[i].alignment);
+		if (i > 0) {
+			REQUIRE(events[i].time >= events[i - 1].time);
+			wentUp |= events[i].object > events[i - 1].object;
+			wentDown |= events[i].object < events[i - 1].object;
+		}
+	}
+	REQUIRE(wentUp);
+	REQUIRE(wentDown);
+
+	// a policy record names every policy before its first event
+	REQUIRE(events[0].policy == events[1].policy);
+	REQUIRE(events[2].policy != events[0].policy);
+	REQUIRE(events[2].policy < policyNames.size());
+	REQUIRE(policyNames[events[0].policy] == mem::type_name<TracedPolicy>());
+	REQUIRE(policyNames[events[2].policy] == mem::type_name<TracedArrayPolicy>());
+
+	// threads are numbered in the order they first allocate
+	REQUIRE(events[6].thread != events[0].thread);
+	REQUIRE(events[7].thread == events[0].thread);
+	REQUIRE(events[8].thread == events[0].thread);
+}
+
+TEST_CASE( "AllocationTrace names the policies again in every trace", "[AllocationTrace]" ) {
+	std::string path = "allocation_trace_test.trace";
+	Allocator<Traced, TracedPolicy> allocator;
+
+	for (int trace = 0; trace < 2; ++trace) {
+		REQUIRE(mem::AllocationTrace::get().start(path));
+		allocator.deallocate(allocator.allocate(1), 1);
+		REQUIRE(mem::AllocationTrace::get().stop() == 2);
+
+		std::vector<mem::TraceEvent> events;
+		std::vector<std::string> policyNames;
+		REQUIRE(mem::AllocationTrace::read(path, events, policyNames));
+		REQUIRE(events.size() == 2);
+		REQUIRE(policyNames[events[0].policy] == mem::type_name<TracedPolicy>());
+	}
+	std::remove(path.c_str());
+}
+
+TEST_CASE( "AllocationTrace::read rejects what isn't a whole trace", "[AllocationTrace]" ) {
+	std::string path = "allocation_trace_test.trace";
+	Allocator<Traced, TracedPolicy> allocator;
+	REQUIRE(mem::AllocationTrace::get().start(path));
+	allocator.deallocate(allocator.allocate(1), 1);
+	mem::AllocationTrace::get().stop();
+
+	std::vector<unsigned char> data;
+	{
+		FILE* file = fopen(path.c_str(), "rb");
+		REQUIRE(file);
+		for (int c; (c = fgetc(file)) != EOF; )
+			data.push_back((unsigned char)c);
+		fclose(file);
+	}
+	auto rewrite = [&](const std::vector<unsigned char>& bytes) {
+		FILE* file = fopen(path.c_str(), "wb");
+		REQUIRE(file);
+		fwrite(bytes.data(), 1, bytes.size(), file);
+		fclose(file);
+	};
+	std::vector<mem::TraceEvent> events;
+	std::vector<std::string> policyNames;
+
+	SECTION( "cut short in the middle of an event" ) {
+		rewrite(std::vector<unsigned char>(data.begin(), data.end() - 1));
+		REQUIRE_FALSE(mem::AllocationTrace::read(path, events, policyNames));
+	}
+
+	SECTION( "without the magic" ) {
+		std::vector<unsigned char> bytes = data;
+		bytes[0] = 'X';
+		rewrite(bytes);
+		REQUIRE_FALSE(mem::AllocationTrace::read(path, events, policyNames));
+	}
+
+	SECTION( "from another version" ) {
+		std::vector<unsigned char> bytes = data;
+		bytes[strlen(mem::AllocationTrace::MAGIC)] = mem::AllocationTrace::VERSION + 1;
+		rewrite(bytes);
+		REQUIRE_FALSE(mem::AllocationTrace::read(path, events, policyNames));
+	}
+
+	std::remove(path.c_str());
+	REQUIRE_FALSE(mem::AllocationTrace::read(path, events, policyNames));
+}
@@ -0,0 +1,186 @@
+#include "catch.hpp"
+#include <cstddef>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <stdint.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include "MemoryPool.hpp"
+
+namespace {
+
+	const unsigned int NUM_THREADS = 8;
+
+	struct alignas(16) Chunk {
+		unsigned char bytes[16];
+	};
+
+}
+
+TEST_CASE( "lock_free_list pops what was pushed, newest first", "[FreeList]" ) {
+	Chunk chunks[3];
+	mem::lock_free_list list;
+	REQUIRE(list.empty());
+
+	for (Chunk& chunk : chunks)
+		list.push(chunk.bytes);
+	REQUIRE(list.front() == chunks[2].bytes);
+	REQUIRE(list.pop() == chunks[2].bytes);
+	REQUIRE(list.pop() == chunks[1].bytes);
+	REQUIRE(list.pop() == chunks[0].bytes);
+	REQUIRE(list.pop() == nullptr);
+	REQUIRE(list.empty());
+}
+
+TEST_CASE( "lock_free_list head changes when the same chunk comes back on top", "[FreeList]" ) {
+	// the ABA case played out on one thread: a pop reads head A and its link B, then other threads pop
+	// A, pop B and push A back.  The stalled pop's swap compares against the head word it read, which
+	// must not match any more even though A is on top again
+	Chunk chunks[3];
+	mem::lock_free_list list;
+	list.push(chunks[0].bytes);
+	list.push(chunks[1].bytes);
+	list.push(chunks[2].bytes);
+
+	// the list is just its head, pointer and tag
+	static_assert(sizeof(mem::lock_free_list) == (MEM_HAS_DOUBLE_WIDTH_CAS ? 16 : 8), "the list is just its head");
+	unsigned char stale[sizeof(list)];
+	memcpy(stale, &list, sizeof(list));
+	unsigned char* a = list.front();
+	REQUIRE(mem::lock_free_list::getNext(a) == chunks[1].bytes);
+
+	REQUIRE(list.pop() == a);
+	REQUIRE(list.pop() == chunks[1].bytes);
+	list.push(a);
+
+	REQUIRE(list.front() == a);
+	REQUIRE(mem::lock_free_list::getNext(a) == chunks[0].bytes);
+	REQUIRE(memcmp(&list, stale, sizeof(list)) != 0);
+}
+
+TEST_CASE( "lock_free_list survives threads recycling the same few chunks", "[FreeList]" ) {
+	// with a handful of chunks every pop races against the same chunk being popped, pushed back and
+	// popped again by other threads, which is the ABA case.  An untagged head would lose or duplicate
+	// chunks here
+	const size_t NUM_CHUNKS = 4;
+	const unsigned int ROUNDS = 100000;
+	Chunk chunks[NUM_CHUNKS];
+	mem::lock_free_list list;
+	for (Chunk& chunk : chunks)
+		list.push(chunk.bytes);
+
+	std::atomic<unsigned int> duplicates{ 0 };
+	std::atomic<unsigned char> owner[NUM_CHUNKS];
+	for (auto& flag : owner)
+		flag.store(0);
+
+	std::vector<std::thread> threads;
+	for (unsigned int t = 0; t < NUM_THREADS; ++t) {
+		threads.emplace_back([&] {
+			// pop two and push them back the other way round, so the head keeps coming back to a chunk
+			// whose link has changed in the meantime
+			for (unsigned int i = 0; i < ROUNDS; ++i) {
+				unsigned char* held[2] = { list.pop(), list.pop() };
+				for (unsigned char* chunk : held) {
+					if (!chunk)
+						continue;
+					// nobody else may hold the chunk while we do
+					if (owner[reinterpret_cast<Chunk*>(chunk) - chunks].exchange(1))
+						++duplicates;
+				}
+				for (unsigned char* chunk : held) {
+					if (!chunk)
+						continue;
+					owner[reinterpret_cast<Chunk*>(chunk) - chunks].store(0);
+					list.push(chunk);
+				}
+			}
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+
+	REQUIRE(duplicates == 0);
+
+	std::set<unsigned char*> found;
+	for (unsigned char* chunk = list.takeAll(); chunk; chunk = mem::lock_free_list::getNext(chunk))
+		REQUIRE(found.insert(chunk).second);
+	REQUIRE(found.size() == NUM_CHUNKS);
+	REQUIRE(list.empty());
+}
+
+TEST_CASE( "lock-free MemoryPool hands every live chunk to one thread only", "[FreeList][MemoryPool]" ) {
+	typedef mem::MemoryPool<sizeof(size_t) * 4, alignof(size_t), mem::lock_free_list> PoolT;
+	std::unique_ptr<PoolT> pool = PoolT::create();
+	REQUIRE(pool->init(16));
+
+	// each thread stamps its chunks and hands half of them to whichever thread comes next, which checks
+	// the stamps before freeing them.  A chunk handed out twice shows up as a torn stamp
+	const unsigned int ROUNDS = 200;
+	const unsigned int BATCH = 256;
+	std::mutex handoffMutex;
+	std::vector<size_t*> handoff;
+	std::atomic<unsigned int> corrupted{ 0 };
+	std::atomic<unsigned int> failed{ 0 };
+
+	auto check = [&](size_t* ptr) {
+		if (!std::all_of(ptr, ptr + 4, [&](size_t word) { return word == ptr[0]; }))
+			++corrupted;
+	};
+
+	std::vector<std::thread> threads;
+	for (unsigned int t = 0; t < NUM_THREADS; ++t) {
+		threads.emplace_back([&, t] {
+			std::vector<size_t*> mine;
+			std::vector<size_t*> theirs;
+			for (unsigned int round = 0; round < ROUNDS; ++round) {
+				for (unsigned int i = 0; i < BATCH; ++i) {
+					size_t* ptr = static_cast<size_t*>(pool->alloc());
+					if (!ptr) {
+						++failed;
+						continue;
+					}
+					std::fill(ptr, ptr + 4, (size_t(t) << 32) | i);
+					mine.push_back(ptr);
+				}
+				for (size_t* ptr : mine) {
+					check(ptr);
+					if ((ptr[0] >> 32) != t)
+						++corrupted;
+				}
+
+				size_t half = mine.size() / 2;
+				{
+					std::lock_guard<std::mutex> lock(handoffMutex);
+					handoff.insert(handoff.end(), mine.begin() + half, mine.end());
+					theirs.swap(handoff);
+				}
+				mine.resize(half);
+				for (size_t* ptr : mine)
+					pool->free(ptr);
+				for (size_t* ptr : theirs) {
+					check(ptr);
+					pool->free(ptr);
+				}
+				mine.clear();
+				theirs.clear();
+			}
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+	for (size_t* ptr : handoff)
+		pool->free(ptr);
+
+	REQUIRE(corrupted == 0);
+	REQUIRE(failed == 0);
+
+	mem::PoolStats stats = pool->getStats();
+	REQUIRE(stats.liveObjects == 0);
+	REQUIRE(stats.allocs == size_t(NUM_THREADS) * ROUNDS * BATCH);
+	REQUIRE(stats.frees == stats.allocs);
+}
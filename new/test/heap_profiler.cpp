@@ -0,0 +1,113 @@
+#include "catch.hpp"
+#include <cstddef>
+#include <memory>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Allocator.hpp"
+#include "ListPoolPolicy.hpp"
+#include "HeapProfiler.hpp"
+
+namespace {
+
+	struct Sampled { unsigned char bytes[32]; };
+
+	typedef Allocator<Sampled, list_pool_policy<Sampled>> SampledAllocator;
+
+	// the totals on the first line of a profile: live objects, live bytes, allocations, allocated bytes
+	struct Totals {
+		unsigned long long liveCount, liveBytes, allocCount, allocBytes;
+	};
+
+	Totals readTotals(const std::string& profile) {
+		Totals totals{ 0, 0, 0, 0 };
+		sscanf(profile.c_str(), "heap profile: %llu: %llu [%llu: %llu]", &totals.liveCount, &totals.liveBytes, &totals.allocCount, &totals.allocBytes);
+		return totals;
+	}
+
+	// a thread only notices start() when its countdown runs out, run it out
+	void startProfiler(size_t interval) {
+		mem::HeapProfiler::get().start(interval);
+		mem::HeapProfiler::recordAlloc(nullptr, mem::HeapProfiler::DISABLED_INTERVAL + 1);
+	}
+
+}
+
+TEST_CASE( "HeapProfiler samples every allocation at an interval of one byte", "[HeapProfiler]" ) {
+	startProfiler(1);
+	REQUIRE(mem::HeapProfiler::get().isEnabled());
+	REQUIRE(mem::HeapProfiler::get().getInterval() == 1);
+
+	SampledAllocator allocator;
+	std::vector<Sampled*> objects;
+	for (int i = 0; i < 100; ++i)
+		objects.push_back(allocator.allocate(1));
+	for (int i = 0; i < 40; ++i)
+		allocator.deallocate(objects[i], 1);
+
+	std::string profile = mem::HeapProfiler::get().getProfile();
+	Totals totals = readTotals(profile);
+	REQUIRE(totals.liveCount == 60);
+	REQUIRE(totals.liveBytes == 60 * sizeof(Sampled));
+	REQUIRE(totals.allocCount == 100);
+	REQUIRE(totals.allocBytes == 100 * sizeof(Sampled));
+	REQUIRE(profile.find("@ heap_v2/1\n") != std::string::npos);
+	REQUIRE(profile.find("\nMAPPED_LIBRARIES:\n") != std::string::npos);
+
+	// stopped, nothing new is sampled but frees still take samples off the live set
+	mem::HeapProfiler::get().stop();
+	REQUIRE_FALSE(mem::HeapProfiler::get().isEnabled());
+	Sampled* extra = allocator.allocate(1);
+	for (int i = 40; i < 100; ++i)
+		allocator.deallocate(objects[i], 1);
+	allocator.deallocate(extra, 1);
+
+	totals = readTotals(mem::HeapProfiler::get().getProfile());
+	REQUIRE(totals.liveCount == 0);
+	REQUIRE(totals.liveBytes == 0);
+	REQUIRE(totals.allocCount == 100);
+}
+
+TEST_CASE( "HeapProfiler takes about one sample per interval", "[HeapProfiler]" ) {
+	const size_t INTERVAL = 4096;
+	const size_t COUNT = 100000;
+	startProfiler(INTERVAL);
+
+	SampledAllocator allocator;
+	std::vector<Sampled*> objects;
+	for (size_t i = 0; i < COUNT; ++i)
+		objects.push_back(allocator.allocate(1));
+	mem::HeapProfiler::get().stop();
+	for (Sampled* object : objects)
+		allocator.deallocate(object, 1);
+
+	// the gaps are exponential, the count is within a few percent of the mean for this many
+	double expected = double(COUNT * sizeof(Sampled)) / INTERVAL;
+	Totals totals = readTotals(mem::HeapProfiler::get().getProfile());
+	REQUIRE(totals.allocCount > expected * 0.8);
+	REQUIRE(totals.allocCount < expected * 1.2);
+	REQUIRE(totals.liveCount == 0);
+}
+
+TEST_CASE( "HeapProfiler writes the profile to a file", "[HeapProfiler]" ) {
+	startProfiler(1);
+	SampledAllocator allocator;
+	Sampled* object = allocator.allocate(1);
+	mem::HeapProfiler::get().stop();
+
+	std::string path = "heap_profiler_test.prof";
+	REQUIRE(mem::HeapProfiler::get().writeProfile(path));
+	std::ifstream file(path);
+	std::stringstream contents;
+	contents << file.rdbuf();
+	REQUIRE(readTotals(contents.str()).liveCount == 1);
+	std::remove(path.c_str());
+
+	allocator.deallocate(object, 1);
+	// start() forgets the earlier samples
+	mem::HeapProfiler::get().start();
+	mem::HeapProfiler::get().stop();
+	REQUIRE(readTotals(mem::HeapProfiler::get().getProfile()).allocCount == 0);
+}
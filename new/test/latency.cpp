@@ -0,0 +1,95 @@
+#include "catch.hpp"
+#include <cstddef>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "MemoryPool.hpp"
+
+TEST_CASE( "LatencyHistogram is exact for small values", "[Latency]" ) {
+	mem::LatencyHistogram histogram;
+	for (uint64_t value = 1; value <= 10; ++value)
+		histogram.record(value);
+
+	REQUIRE(histogram.getCount() == 10);
+	REQUIRE(histogram.getMax() == 10);
+	REQUIRE(histogram.percentile(0.5) == 5);
+	REQUIRE(histogram.percentile(0.9) == 9);
+	REQUIRE(histogram.percentile(1.0) == 10);
+
+	histogram.clear();
+	REQUIRE(histogram.getCount() == 0);
+	REQUIRE(histogram.getMax() == 0);
+	REQUIRE(histogram.percentile(0.5) == 0);
+}
+
+TEST_CASE( "LatencyHistogram percentiles are within a bucket of the true value", "[Latency]" ) {
+	mem::LatencyHistogram histogram;
+	const uint64_t COUNT = 100000;
+	for (uint64_t value = 1; value <= COUNT; ++value)
+		histogram.record(value);
+
+	// never below the true value and at most 1/SUB_BUCKETS above it
+	for (double fraction : { 0.5, 0.9, 0.99, 0.999 }) {
+		uint64_t exact = (uint64_t)(fraction * COUNT + 0.5);
+		uint64_t value = histogram.percentile(fraction);
+		REQUIRE(value >= exact);
+		REQUIRE(value <= exact + exact / mem::LatencyHistogram::SUB_BUCKETS);
+	}
+	REQUIRE(histogram.percentile(1.0) == COUNT);
+}
+
+TEST_CASE( "LatencyHistogram keeps values past the last bucket", "[Latency]" ) {
+	mem::LatencyHistogram histogram;
+	uint64_t huge = uint64_t(1) << 60;
+	histogram.record(3);
+	histogram.record(huge);
+	REQUIRE(histogram.getCount() == 2);
+	REQUIRE(histogram.getMax() == huge);
+	REQUIRE(histogram.percentile(1.0) == huge);
+}
+
+TEST_CASE( "LatencyHistogram counts every record from several threads", "[Latency]" ) {
+	mem::LatencyHistogram histogram;
+	std::vector<std::thread> threads;
+	for (unsigned int t = 0; t < 4; ++t) {
+		threads.emplace_back([&, t] {
+			for (uint64_t value = 0; value < 10000; ++value)
+				histogram.record(value * (t + 1));
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+	REQUIRE(histogram.getCount() == 40000);
+	REQUIRE(histogram.getMax() == 9999 * 4);
+}
+
+TEST_CASE( "MemoryPool records alloc, free and grow latencies while enabled", "[Latency][MemoryPool]" ) {
+	typedef mem::MemoryPool<24> PoolT;
+	std::unique_ptr<PoolT> pool = PoolT::create();
+	REQUIRE(pool->init(16));
+	REQUIRE(pool->getLatency() == nullptr);
+
+	pool->enableLatencyHistograms(true);
+	std::vector<void*> ptrs;
+	for (int i = 0; i < 100; ++i)
+		ptrs.push_back(pool->alloc());
+	for (void* ptr : ptrs)
+		pool->free(ptr);
+
+	mem::PoolLatency* latency = pool->getLatency();
+	REQUIRE(latency);
+	REQUIRE(latency->alloc.getCount() == 100);
+	REQUIRE(latency->free.getCount() == 100);
+	REQUIRE(latency->grow.getCount() == pool->getNumBlocks() - 1);
+
+	// kept but no longer added to once switched off
+	pool->enableLatencyHistograms(false);
+	pool->free(pool->alloc());
+	REQUIRE(latency->alloc.getCount() == 100);
+
+	std::string report = pool->getLatencyReport();
+	REQUIRE(report.find("alloc  count        100") != std::string::npos);
+	REQUIRE(report.find("grow") != std::string::npos);
+}
@@ -0,0 +1,124 @@
+#include "catch.hpp"
+#include <cstddef>
+#include <memory>
+#include <algorithm>
+#include <functional>
+#include <numeric>
+#include <stdint.h>
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+#include "Allocator.hpp"
+#include "ListPoolPolicy.hpp"
+
+namespace {
+
+	struct Node24 { unsigned char bytes[24]; };
+	struct alignas(64) Wide { unsigned char bytes[8]; };
+
+	template<typename T, size_t alignment = 0>
+	using ListAllocator = Allocator<T, list_pool_policy<T, alignment>>;
+
+	bool aligned(const void* ptr, size_t alignment) { return (uintptr_t)ptr % alignment == 0; }
+
+}
+
+TEST_CASE( "list_pool_policy serves short arrays as runs", "[ListPool]" ) {
+	typedef list_pool_policy<Node24> PolicyT;
+	static_assert(PolicyT::NUM_RUN_POOLS == 5, "runs of 2, 4, 8, 16 and 32 fit in MAX_RUN_BYTES");
+	static_assert(PolicyT::MAX_RUN == 32, "");
+	static_assert(list_pool_policy<unsigned char[600]>::NUM_RUN_POOLS == 0, "a run of two is already too big");
+
+	ListAllocator<Node24> allocator;
+
+	// three objects take a run of four
+	unsigned long before = PolicyT::run_pool_type<4>::getStats().allocs;
+	Node24* three = allocator.allocate(3);
+	REQUIRE(PolicyT::run_pool_type<4>::getStats().allocs > before);
+	memset(three, 0x33, 3 * sizeof(Node24));
+
+	// every count up to the longest run, all held at once and none overlapping
+	std::vector<std::pair<Node24*, size_t>> arrays;
+	for (size_t count = 2; count <= PolicyT::MAX_RUN; ++count) {
+		Node24* array = allocator.allocate(count);
+		memset(array, (int)count, count * sizeof(Node24));
+		arrays.emplace_back(array, count);
+	}
+	size_t intact = 0;
+	for (auto& array : arrays) {
+		const unsigned char* bytes = array.first->bytes;
+		intact += std::all_of(bytes, bytes + array.second * sizeof(Node24), [&](unsigned char b) { return b == array.second; });
+	}
+	REQUIRE(intact == arrays.size());
+	for (auto& array : arrays)
+		allocator.deallocate(array.first, array.second);
+	allocator.deallocate(three, 3);
+
+	// longer ones go to operator new and leave the run pools alone
+	unsigned long longest = PolicyT::run_pool_type<32>::getStats().allocs;
+	Node24* big = allocator.allocate(PolicyT::MAX_RUN + 1);
+	REQUIRE(PolicyT::run_pool_type<32>::getStats().allocs == longest);
+	allocator.deallocate(big, PolicyT::MAX_RUN + 1);
+}
+
+TEST_CASE( "list_pool_policy backs vectors and hash tables", "[ListPool]" ) {
+	std::vector<int, ListAllocator<int>> vector;
+	for (int i = 0; i < 1000; ++i)
+		vector.push_back(i);
+	REQUIRE(std::accumulate(vector.begin(), vector.end(), 0) == 999 * 1000 / 2);
+
+	std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, ListAllocator<std::pair<const int, int>>> map;
+	for (int i = 0; i < 1000; ++i)
+		map[i] = i * 2;
+	REQUIRE(map.size() == 1000);
+	REQUIRE(map[999] == 1998);
+	map.clear();
+	map.rehash(0);
+}
+
+TEST_CASE( "list_pool_policy keeps over-aligned objects aligned", "[ListPool]" ) {
+	SECTION( "aligned types" ) {
+		static_assert(list_pool_policy<Wide>::ALIGNMENT == 64, "");
+		ListAllocator<Wide> allocator;
+		std::vector<Wide*> objects;
+		for (int i = 0; i < 500; ++i)
+			objects.push_back(allocator.allocate(1));
+		Wide* run = allocator.allocate(3);
+		Wide* big = allocator.allocate(100);
+
+		size_t misaligned = 0;
+		for (Wide* object : objects)
+			misaligned += !aligned(object, 64);
+		REQUIRE(misaligned == 0);
+		REQUIRE(aligned(run, 64));
+		REQUIRE(aligned(big, 64));
+
+		for (Wide* object : objects)
+			allocator.deallocate(object, 1);
+		allocator.deallocate(run, 3);
+		allocator.deallocate(big, 100);
+	}
+
+	SECTION( "an alignment asked for, carried over by rebinds" ) {
+		typedef ListAllocator<int, mem::CACHE_LINE_SIZE> IntAllocator;
+		static_assert(IntAllocator::ALIGNMENT == mem::CACHE_LINE_SIZE, "");
+		static_assert(IntAllocator::rebind<double>::other::ALIGNMENT == mem::CACHE_LINE_SIZE, "");
+
+		IntAllocator ints;
+		IntAllocator::rebind<double>::other doubles(ints);
+		int* a = ints.allocate(1);
+		int* b = ints.allocate(1);
+		double* c = doubles.allocate(2);
+		REQUIRE(aligned(a, 64));
+		REQUIRE(aligned(b, 64));
+		REQUIRE(aligned(c, 64));
+		REQUIRE((uintptr_t)b - (uintptr_t)a >= 64);
+		ints.deallocate(a, 1);
+		ints.deallocate(b, 1);
+		doubles.deallocate(c, 2);
+
+		// pools of different alignments can't free each other's memory
+		REQUIRE(ints != ListAllocator<int>());
+		REQUIRE(ints == doubles);
+	}
+}
@@ -0,0 +1,175 @@
+#include "catch.hpp"
+#include <atomic>
+#include <functional>
+#include <map>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+#include "MonotonicArenaPolicy.hpp"
+#include "PoolRegistry.hpp"
+
+namespace {
+
+	typedef mem::MonotonicArena<> Arena;
+
+	template<typename T>
+	using ArenaAllocator = Allocator<T, monotonic_arena_policy<T>>;
+
+	typedef std::map<int, int, std::less<int>, ArenaAllocator<std::pair<const int, int>>> ArenaMap;
+
+	// this arena's entry in a registry snapshot
+	mem::PoolInfo findArena(const Arena& arena) {
+		uint64_t id = arena.describe().id;
+		for (const mem::PoolInfo& info : mem::PoolRegistry::get().getPools()) {
+			if (info.id == id)
+				return info;
+		}
+		FAIL("arena is not in the registry");
+		return mem::PoolInfo();
+	}
+
+}
+
+TEST_CASE( "MonotonicArena bumps through its chunks", "[MonotonicArena]" ) {
+	Arena arena(1024);
+	REQUIRE(arena.getNumChunks() == 0);
+
+	SECTION( "allocations are aligned and follow each other" ) {
+		char* first = static_cast<char*>(arena.alloc(3, 1));
+		char* second = static_cast<char*>(arena.alloc(8, 8));
+		char* third = static_cast<char*>(arena.alloc(16, 64));
+		REQUIRE((uintptr_t)second % 8 == 0);
+		REQUIRE((uintptr_t)third % 64 == 0);
+		REQUIRE(second > first);
+		REQUIRE(third > second);
+		REQUIRE(arena.getNumAllocs() == 3);
+		REQUIRE(arena.getUsedBytes() == size_t(third + 16 - first));
+		REQUIRE(arena.getNumChunks() == 1);
+		REQUIRE(arena.getReservedBytes() == 1024);
+	}
+
+	SECTION( "a full chunk makes a bigger one, a big request gets one of its own size" ) {
+		for (int i = 0; i < 5; ++i)
+			arena.alloc(256, 8);
+		REQUIRE(arena.getNumChunks() == 2);
+		REQUIRE(arena.getReservedBytes() == 1024 + 2048);
+
+		arena.alloc(100000, 8);
+		REQUIRE(arena.getNumChunks() == 3);
+		REQUIRE(arena.getReservedBytes() == 1024 + 2048 + 100000);
+	}
+
+	SECTION( "reset() refills the same chunks without allocating" ) {
+		void* first = arena.alloc(64, 8);
+		for (int i = 0; i < 100; ++i)
+			arena.alloc(64, 8);
+		size_t chunks = arena.getNumChunks();
+		size_t reserved = arena.getReservedBytes();
+		size_t used = arena.getUsedBytes();
+		REQUIRE(chunks > 1);
+
+		for (int cycle = 0; cycle < 10; ++cycle) {
+			arena.reset();
+			REQUIRE(arena.getNumAllocs() == 0);
+			REQUIRE(arena.getUsedBytes() == 0);
+			REQUIRE(arena.alloc(64, 8) == first);
+			for (int i = 0; i < 100; ++i)
+				arena.alloc(64, 8);
+			REQUIRE(arena.getNumChunks() == chunks);
+			REQUIRE(arena.getReservedBytes() == reserved);
+		}
+		REQUIRE(arena.getPeakBytes() == used);
+	}
+
+	SECTION( "release() gives the chunks back" ) {
+		arena.alloc(5000, 8);
+		REQUIRE(arena.getReservedBytes() > 0);
+		arena.release();
+		REQUIRE(arena.getNumChunks() == 0);
+		REQUIRE(arena.getReservedBytes() == 0);
+		REQUIRE(arena.alloc(16, 8) != nullptr);
+		REQUIRE(arena.getNumChunks() == 1);
+	}
+}
+
+TEST_CASE( "MonotonicArena shows up in the PoolRegistry", "[MonotonicArena]" ) {
+	Arena arena(1024);
+	for (int i = 0; i < 10; ++i)
+		arena.alloc(100, 8);
+
+	mem::PoolInfo info = findArena(arena);
+	REQUIRE(info.kind == std::string("MonotonicArena"));
+	REQUIRE(info.liveObjects == 10);
+	REQUIRE(info.peakObjects == 10);
+	REQUIRE(info.usedBytes == arena.getUsedBytes());
+	REQUIRE(info.reservedBytes == arena.getReservedBytes());
+	REQUIRE(info.numBlocks == arena.getNumChunks());
+
+	arena.reset();
+	arena.alloc(100, 8);
+	info = findArena(arena);
+	REQUIRE(info.liveObjects == 1);
+	REQUIRE(info.peakObjects == 10);
+
+	SECTION( "snapshots can be taken while the owner allocates" ) {
+		arena.reset();
+		std::atomic<bool> done(false);
+		std::thread owner([&] {
+			for (int cycle = 0; cycle < 200; ++cycle) {
+				for (int i = 0; i < 100; ++i)
+					arena.alloc(48, 16);
+				arena.reset();
+			}
+			done = true;
+		});
+		size_t snapshots = 0;
+		while (!done || snapshots == 0) {
+			info = findArena(arena);
+			REQUIRE(info.liveObjects <= 100);
+			++snapshots;
+		}
+		owner.join();
+		REQUIRE(findArena(arena).peakObjects == 100);
+	}
+}
+
+TEST_CASE( "monotonic_arena_policy puts containers on an arena", "[MonotonicArena]" ) {
+	Arena arena(1024);
+	Arena other(1024);
+
+	{
+		ArenaMap map{ std::less<int>(), ArenaAllocator<std::pair<const int, int>>(arena) };
+		for (int i = 0; i < 1000; ++i)
+			map[i] = i * 2;
+		REQUIRE(map.at(999) == 1998);
+		REQUIRE(arena.getNumAllocs() == 1000);
+	}
+	// nothing is freed until the reset
+	REQUIRE(arena.getNumAllocs() == 1000);
+	arena.reset();
+	REQUIRE(arena.getUsedBytes() == 0);
+
+	ArenaAllocator<int> a(arena);
+	ArenaAllocator<int> b(other);
+	ArenaAllocator<double> rebound(a);
+	REQUIRE(a == rebound);
+	REQUIRE(a != b);
+	REQUIRE(&rebound.getArena() == &arena);
+
+	typedef std::allocator_traits<ArenaAllocator<int>> Traits;
+	REQUIRE(Traits::propagate_on_container_copy_assignment::value);
+	REQUIRE(Traits::propagate_on_container_move_assignment::value);
+	REQUIRE(Traits::propagate_on_container_swap::value);
+	REQUIRE_FALSE(Traits::is_always_equal::value);
+
+	// the arena goes along with the contents
+	std::vector<int, ArenaAllocator<int>> first({ 1, 2, 3 }, a);
+	std::vector<int, ArenaAllocator<int>> second(b);
+	second = std::move(first);
+	REQUIRE(&second.get_allocator().getArena() == &arena);
+	REQUIRE(second.size() == 3);
+	first = std::vector<int, ArenaAllocator<int>>(b);
+	first.swap(second);
+	REQUIRE(&first.get_allocator().getArena() == &arena);
+	REQUIRE(&second.get_allocator().getArena() == &other);
+}
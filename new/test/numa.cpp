@@ -0,0 +1,88 @@
+#include "catch.hpp"
+#include <cstddef>
+#include <memory>
+#include <list>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "Allocator.hpp"
+#include "NumaPoolPolicy.hpp"
+
+namespace {
+
+	struct Node {
+		size_t mValue;
+		Node* mNext;
+	};
+
+	typedef numa_pool_policy<Node>::pool_type ArenasT;
+
+	unsigned long liveObjects() {
+		unsigned long live = 0;
+		for (unsigned int i = 0; i < ArenasT::getNumArenas(); ++i)
+			live += ArenasT::getArena(i)->getStats().liveObjects;
+		return live;
+	}
+
+}
+
+TEST_CASE( "NumaArenas has an arena per node and falls back to one", "[Numa]" ) {
+	unsigned int numNodes = mem::numa_node_count();
+	REQUIRE(numNodes >= 1);
+	REQUIRE(ArenasT::getNumArenas() == numNodes);
+
+	// nodes past the last arena share the first
+	REQUIRE(ArenasT::getArena(numNodes) == ArenasT::getArena(0));
+	REQUIRE(ArenasT::getArena(0)->getCapacity() >= ArenasT::INITIAL_OBJECTS);
+}
+
+TEST_CASE( "numa_pool_policy allocates from the arenas", "[Numa]" ) {
+	Allocator<Node, numa_pool_policy<Node>> allocator;
+	unsigned long live = liveObjects();
+
+	std::vector<Node*> nodes;
+	for (size_t i = 0; i < 3000; ++i) {
+		nodes.push_back(allocator.allocate(1));
+		nodes.back()->mValue = i;
+	}
+	REQUIRE(liveObjects() == live + 3000);
+	if (mem::numa_node_count() == 1)
+		REQUIRE(ArenasT::getArena(0)->getStats().liveObjects == live + 3000);
+
+	size_t intact = 0;
+	for (size_t i = 0; i < nodes.size(); ++i)
+		intact += nodes[i]->mValue == i;
+	REQUIRE(intact == nodes.size());
+
+	// arrays don't touch the arenas
+	Node* array = allocator.allocate(3);
+	REQUIRE(liveObjects() == live + 3000);
+	allocator.deallocate(array, 3);
+
+	// freed on another thread, they still go back to the arena they came from
+	std::thread([&] {
+		for (Node* node : nodes)
+			allocator.deallocate(node, 1);
+	}).join();
+	REQUIRE(liveObjects() == live);
+
+	ArenasT::trim();
+	REQUIRE(liveObjects() == live);
+}
+
+TEST_CASE( "numa_pool_policy allocators are interchangeable", "[Numa]" ) {
+	typedef Allocator<Node, numa_pool_policy<Node>> NodeAllocator;
+	static_assert(std::allocator_traits<NodeAllocator>::is_always_equal::value, "");
+
+	NodeAllocator a;
+	NodeAllocator::rebind<int>::other b(a);
+	REQUIRE(a == b);
+
+	std::list<size_t, Allocator<size_t, numa_pool_policy<size_t>>> list;
+	for (size_t i = 0; i < 100; ++i)
+		list.push_back(i);
+	std::list<size_t, Allocator<size_t, numa_pool_policy<size_t>>> other;
+	other.splice(other.end(), list);
+	REQUIRE(other.size() == 100);
+	REQUIRE(list.empty());
+}
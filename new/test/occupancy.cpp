@@ -0,0 +1,100 @@
+#include "catch.hpp"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include "MemoryPool.hpp"
+
+namespace {
+
+	typedef mem::MemoryPool<16> PoolT;
+
+}
+
+TEST_CASE( "getBlockUsage follows the live objects of every block", "[Occupancy][MemoryPool]" ) {
+	std::unique_ptr<PoolT> pool = PoolT::create();
+	REQUIRE(pool->init(16));
+
+	std::vector<void*> ptrs;
+	for (int i = 0; i < 17; ++i)
+		ptrs.push_back(pool->alloc());
+
+	// the first block is full, the second has one chunk carved off
+	std::vector<mem::BlockUsage> usage = pool->getBlockUsage();
+	REQUIRE(usage.size() == 2);
+	REQUIRE(usage[0].numObjects == 16);
+	REQUIRE(usage[0].liveObjects == 16);
+	REQUIRE(usage[0].longestFreeRun == 0);
+	REQUIRE(usage[1].numObjects == 32);
+	REQUIRE(usage[1].liveObjects == 1);
+	REQUIRE(usage[1].uncarved == 31);
+	REQUIRE(usage[1].longestFreeRun == 31);
+
+	// every other object of the first block goes
+	for (int i = 0; i < 16; i += 2)
+		pool->free(ptrs[i]);
+	usage = pool->getBlockUsage();
+	REQUIRE(usage[0].liveObjects == 8);
+	REQUIRE(usage[0].longestFreeRun == 1);
+	REQUIRE(pool->getFragmentation() == Approx((8.0 + 31.0) / 48.0));
+
+	// walking the free list leaves it as it was
+	REQUIRE(pool->alloc() == ptrs[14]);
+
+	for (int i = 1; i < 16; i += 2)
+		pool->free(ptrs[i]);
+	pool->free(ptrs[14]);
+	pool->free(ptrs[16]);
+	REQUIRE(pool->getFragmentation() == 0);
+}
+
+TEST_CASE( "getOccupancyMap draws a cell per block", "[Occupancy][MemoryPool]" ) {
+	std::unique_ptr<PoolT> pool = PoolT::create();
+	REQUIRE(pool->init(16));
+
+	std::vector<void*> ptrs;
+	for (int i = 0; i < 16 + 32 + 4; ++i)
+		ptrs.push_back(pool->alloc());
+	REQUIRE(pool->getNumBlocks() == 3);
+
+	// full, half and a sliver of the third
+	for (int i = 16; i < 32; ++i)
+		pool->free(ptrs[i]);
+
+	std::string map = pool->getOccupancyMap();
+	REQUIRE(map.find(mem::type_name<PoolT>() + ": 3 blocks, 0 empty, 0 decommitted, 36 live / 112 chunks") == 0);
+	REQUIRE(map.find("[0%] 0  [<25%] 1  [<50%] 0  [<75%] 1  [<100%] 0  [100%] 1") != std::string::npos);
+	REQUIRE(map.find("     0 @+:\n") != std::string::npos);
+
+	// a narrow map wraps
+	REQUIRE(pool->getOccupancyMap(2).find("     0 @+\n     2 :\n") != std::string::npos);
+
+	// decommitted blocks are kept as spares
+	for (int i = 0; i < 16; ++i)
+		pool->free(ptrs[i]);
+	for (size_t i = 32; i < ptrs.size(); ++i)
+		pool->free(ptrs[i]);
+	pool->trim(mem::TRIM_DECOMMIT);
+	map = pool->getOccupancyMap();
+	REQUIRE(map.find("3 blocks, 0 empty, 3 decommitted") != std::string::npos);
+	REQUIRE(map.find("     0 ~~~\n") != std::string::npos);
+}
+
+TEST_CASE( "occupancy_cell and fragmentation_index on hand made blocks", "[Occupancy]" ) {
+	std::vector<mem::BlockUsage> blocks = {
+		{ 70, 0, 0, 70, false },
+		{ 70, 10, 0, 60, false },
+		{ 70, 69, 0, 1, false },
+		{ 70, 70, 0, 0, false },
+		{ 70, 0, 0, 70, true }
+	};
+	REQUIRE(mem::occupancy_cell(blocks[0]) == '.');
+	REQUIRE(mem::occupancy_cell(blocks[1]) == '-');
+	REQUIRE(mem::occupancy_cell(blocks[2]) == '%');
+	REQUIRE(mem::occupancy_cell(blocks[3]) == '@');
+	REQUIRE(mem::occupancy_cell(blocks[4]) == '~');
+
+	// only the occupied blocks count
+	REQUIRE(mem::fragmentation_index(blocks) == Approx(61.0 / 210.0));
+	REQUIRE(mem::fragmentation_index({}) == 0);
+}
@@ -0,0 +1,107 @@
+#include "catch.hpp"
+#include <cstddef>
+#include <memory>
+#include <map>
+#include <memory_resource>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "PoolResource.hpp"
+
+namespace {
+
+	// passes everything on to new and delete and counts what reaches it
+	class CountingResource : public std::pmr::memory_resource
+	{
+	public:
+
+		size_t allocs{ 0 };
+		size_t frees{ 0 };
+
+	protected:
+
+		void* do_allocate(size_t bytes, size_t alignment) override {
+			++allocs;
+			return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+		}
+
+		void do_deallocate(void* ptr, size_t bytes, size_t alignment) override {
+			++frees;
+			std::pmr::new_delete_resource()->deallocate(ptr, bytes, alignment);
+		}
+
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+	};
+
+	typedef mem::PoolResource<> Resource;
+
+}
+
+TEST_CASE( "PoolResource pools what fits a class and passes the rest upstream", "[PoolResource]" ) {
+	REQUIRE(Resource::isPooled(1, 1));
+	REQUIRE(Resource::isPooled(Resource::pool_set_type::MAX_POOLED_SIZE, Resource::pool_set_type::ALIGNMENT));
+	REQUIRE_FALSE(Resource::isPooled(Resource::pool_set_type::MAX_POOLED_SIZE + 1, 1));
+	REQUIRE_FALSE(Resource::isPooled(16, 64));
+
+	CountingResource upstream;
+	Resource resource(&upstream);
+	REQUIRE(resource.upstream_resource() == &upstream);
+
+	void* small = resource.allocate(24, 8);
+	REQUIRE(upstream.allocs == 0);
+	REQUIRE(resource.getPoolSet().getReservedBytes() > 0);
+
+	void* big = resource.allocate(4096, 8);
+	void* aligned = resource.allocate(16, 64);
+	REQUIRE(upstream.allocs == 2);
+	REQUIRE((uintptr_t)aligned % 64 == 0);
+
+	resource.deallocate(small, 24, 8);
+	resource.deallocate(big, 4096, 8);
+	resource.deallocate(aligned, 16, 64);
+	REQUIRE(upstream.frees == 2);
+}
+
+TEST_CASE( "PoolResource backs std::pmr containers", "[PoolResource]" ) {
+	CountingResource upstream;
+	Resource resource(&upstream);
+
+	{
+		// the strings inside the map use the map's resource too
+		std::pmr::map<int, std::pmr::string> map(&resource);
+		for (int i = 0; i < 1000; ++i)
+			map.emplace(i, std::pmr::string(std::to_string(i) + " is a number that needs a heap allocation", &resource));
+		REQUIRE(map.size() == 1000);
+		REQUIRE(map.begin()->second.get_allocator().resource() == &resource);
+		REQUIRE(map[999] == "999 is a number that needs a heap allocation");
+
+		std::pmr::vector<int> vector(&resource);
+		for (int i = 0; i < 10000; ++i)
+			vector.push_back(i);
+		REQUIRE(vector.back() == 9999);
+
+		// nodes and strings come from the pools, only the big vector buffers went upstream
+		REQUIRE(upstream.allocs > 0);
+		REQUIRE(upstream.allocs < 20);
+	}
+	REQUIRE(upstream.frees == upstream.allocs);
+
+	// everything came back, the pools can give all of it up
+	resource.getPoolSet().trim();
+	REQUIRE(resource.getPoolSet().getReservedBytes() == 0);
+}
+
+TEST_CASE( "PoolResources are only equal to themselves", "[PoolResource]" ) {
+	Resource first;
+	Resource second;
+	REQUIRE(first.is_equal(first));
+	REQUIRE_FALSE(first.is_equal(second));
+	REQUIRE(first.upstream_resource() == std::pmr::get_default_resource());
+
+	// containers on different resources copy on move assignment instead of stealing the nodes
+	std::pmr::vector<int> a({ 1, 2, 3 }, &first);
+	std::pmr::vector<int> b(&second);
+	b = std::move(a);
+	REQUIRE(b.get_allocator().resource() == &second);
+	REQUIRE(b.size() == 3);
+}
@@ -0,0 +1,150 @@
+#include "catch.hpp"
+#include <cstddef>
+#include <memory>
+#include <list>
+#include <map>
+#include <string.h>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "Allocator.hpp"
+#include "PoolSetPolicy.hpp"
+
+namespace {
+
+	typedef Allocator<int, pool_set_policy<int>> IntAllocator;
+	typedef std::list<int, IntAllocator> List;
+
+	List makeList(mem::PoolSet<>& pools, int count) {
+		List list{ IntAllocator(pools) };
+		for (int i = 0; i < count; ++i)
+			list.push_back(i);
+		return list;
+	}
+
+}
+
+TEST_CASE( "PoolSet serves every size from the pool of its class", "[PoolSet]" ) {
+	mem::PoolSet<> pools;
+	REQUIRE(pools.getReservedBytes() == 0);
+
+	std::vector<std::pair<void*, size_t>> blocks;
+	for (size_t bytes = 1; bytes <= mem::PoolSet<>::MAX_POOLED_SIZE + 16; bytes += 7) {
+		void* ptr = pools.alloc(bytes);
+		REQUIRE(ptr);
+		memset(ptr, (int)bytes, bytes);
+		blocks.emplace_back(ptr, bytes);
+	}
+	size_t reserved = pools.getReservedBytes();
+	REQUIRE(reserved > 0);
+
+	size_t intact = 0;
+	for (auto& block : blocks)
+		intact += ((unsigned char*)block.first)[block.second - 1] == (unsigned char)block.second;
+	REQUIRE(intact == blocks.size());
+
+	for (auto& block : blocks)
+		pools.free(block.first, block.second);
+	REQUIRE(pools.getReservedBytes() == reserved);
+	REQUIRE(pools.trim() == reserved);
+	REQUIRE(pools.getReservedBytes() == 0);
+}
+
+TEST_CASE( "pool_set_policy allocators are equal when they share a set", "[PoolSet]" ) {
+	typedef std::allocator_traits<IntAllocator> Traits;
+	static_assert(Traits::propagate_on_container_copy_assignment::value, "");
+	static_assert(Traits::propagate_on_container_move_assignment::value, "");
+	static_assert(Traits::propagate_on_container_swap::value, "");
+	static_assert(!Traits::is_always_equal::value, "");
+
+	mem::PoolSet<> first;
+	mem::PoolSet<> second;
+	IntAllocator a(first);
+	IntAllocator b(first);
+	IntAllocator c(second);
+	IntAllocator::rebind<double>::other rebound(a);
+
+	REQUIRE(a == b);
+	REQUIRE(a != c);
+	REQUIRE(a == rebound);
+	REQUIRE(&rebound.getPoolSet() == &first);
+
+	// a copy of a container keeps its set
+	List list = makeList(first, 10);
+	List copy(list);
+	REQUIRE(&copy.get_allocator().getPoolSet() == &first);
+}
+
+TEST_CASE( "the set goes along with the contents", "[PoolSet]" ) {
+	mem::PoolSet<> first;
+	mem::PoolSet<> second;
+
+	SECTION( "on copy assignment" ) {
+		List a = makeList(first, 100);
+		List b = makeList(second, 5);
+		b = a;
+		REQUIRE(&b.get_allocator().getPoolSet() == &first);
+		REQUIRE(b.size() == 100);
+		REQUIRE(a == b);
+	}
+
+	SECTION( "on move assignment, without copying a node" ) {
+		List a = makeList(first, 100);
+		List b = makeList(second, 5);
+		const int* front = &a.front();
+		b = std::move(a);
+		REQUIRE(&b.get_allocator().getPoolSet() == &first);
+		REQUIRE(&b.front() == front);
+		REQUIRE(b.size() == 100);
+	}
+
+	SECTION( "on swap" ) {
+		List a = makeList(first, 100);
+		List b = makeList(second, 5);
+		const int* frontA = &a.front();
+		const int* frontB = &b.front();
+		a.swap(b);
+		REQUIRE(&a.get_allocator().getPoolSet() == &second);
+		REQUIRE(&b.get_allocator().getPoolSet() == &first);
+		REQUIRE(&a.front() == frontB);
+		REQUIRE(&b.front() == frontA);
+	}
+
+	SECTION( "on splice between containers on one set" ) {
+		List a = makeList(first, 100);
+		List b = makeList(first, 5);
+		b.splice(b.end(), a);
+		REQUIRE(b.size() == 105);
+		REQUIRE(a.empty());
+	}
+
+	// everything came back to the set it was allocated from, so the sets are empty again
+	first.trim();
+	second.trim();
+	REQUIRE(first.getReservedBytes() == 0);
+	REQUIRE(second.getReservedBytes() == 0);
+}
+
+TEST_CASE( "a PoolSet on lock_free_list is shared by several threads", "[PoolSet]" ) {
+	typedef mem::PoolSet<mem::default_size_classes, mem::lock_free_list> SharedSet;
+	SharedSet pools;
+	typedef Allocator<std::pair<const int, int>, pool_set_policy<std::pair<const int, int>, SharedSet>> PairAllocator;
+
+	std::vector<std::thread> threads;
+	std::vector<size_t> sizes(4);
+	for (unsigned int t = 0; t < 4; ++t) {
+		threads.emplace_back([&, t] {
+			for (int round = 0; round < 20; ++round) {
+				std::map<int, int, std::less<int>, PairAllocator> map{ PairAllocator(pools) };
+				for (int i = 0; i < 500; ++i)
+					map[i] = i;
+				sizes[t] += map.size();
+			}
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+	for (size_t size : sizes)
+		REQUIRE(size == 20 * 500);
+}
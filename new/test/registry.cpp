@@ -0,0 +1,141 @@
+#include "catch.hpp"
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "MemoryPool.hpp"
+#include "PoolRegistry.hpp"
+#include "../../old/src/ObjectPool.hpp"
+
+// at global scope so the registry reports it under a plain name
+struct RegistryPoint { double x, y; };
+
+namespace {
+
+	typedef mem::MemoryPool<24> PoolT;
+	typedef ObjectPool<RegistryPoint> ObjectPoolT;
+
+	// the entries of a registry snapshot that belong to ids, in the order they joined.  Other tests
+	// leave singleton pools behind, so a whole snapshot isn't the same from run to run
+	std::vector<mem::PoolInfo> findPools(const std::vector<uint64_t>& ids) {
+		std::vector<mem::PoolInfo> pools;
+		for (const mem::PoolInfo& info : mem::PoolRegistry::get().getPools()) {
+			for (uint64_t id : ids) {
+				if (info.id == id)
+					pools.push_back(info);
+			}
+		}
+		REQUIRE(pools.size() == ids.size());
+		return pools;
+	}
+
+	std::string str(size_t value) { return std::to_string(value); }
+
+	// a MemoryPool with 2 of its 64 chunks live and one ObjectPool with 2 of its objects live, both
+	// having peaked at 3
+	struct Pools {
+		Pools() : memoryPool(PoolT::create()), objectPool(ObjectPoolT::create()) {
+			REQUIRE(memoryPool->init(64));
+			for (int i = 0; i < 3; ++i) {
+				chunks.push_back(memoryPool->alloc());
+				handles.push_back(objectPool->createObject(RegistryPoint{ double(i), double(i) }));
+			}
+			memoryPool->free(chunks.back());
+			chunks.pop_back();
+			REQUIRE(handles.back().destroy());
+			handles.pop_back();
+		}
+
+		~Pools() {
+			for (void* chunk : chunks)
+				memoryPool->free(chunk);
+			for (Handle& handle : handles)
+				handle.destroy();
+		}
+
+		std::vector<uint64_t> ids() const { return { memoryPool->getRegistryId(), objectPool->describe().id }; }
+
+		std::unique_ptr<PoolT> memoryPool;
+		std::shared_ptr<ObjectPoolT> objectPool;
+		std::vector<void*> chunks;
+		std::vector<Handle> handles;
+	};
+
+}
+
+TEST_CASE( "PoolRegistry exports a MemoryPool and an ObjectPool as JSON", "[PoolRegistry]" ) {
+	Pools pools;
+	std::vector<uint64_t> ids = pools.ids();
+
+	std::string expected =
+		"{\"pools\":["
+		"{\"id\":" + str(ids[0]) + ",\"kind\":\"MemoryPool\",\"type\":\"" + mem::type_name<PoolT>() + "\""
+		",\"object_size\":24,\"alignment\":" + str(PoolT::OBJECT_ALIGNMENT) + ",\"capacity\":64"
+		",\"live_objects\":2,\"peak_objects\":3,\"blocks\":1"
+		",\"reserved_bytes\":" + str(64 * PoolT::CHUNK_SIZE) + ",\"used_bytes\":48},"
+		"{\"id\":" + str(ids[1]) + ",\"kind\":\"ObjectPool\",\"type\":\"RegistryPoint\""
+		",\"object_size\":" + str(ObjectPoolT::OBJECT_STRIDE) + ",\"alignment\":8"
+		",\"capacity\":" + str(ObjectPoolT::OBJECTS_PER_BLOCK) +
+		",\"live_objects\":2,\"peak_objects\":3,\"blocks\":1"
+		",\"reserved_bytes\":65536,\"used_bytes\":" + str(2 * ObjectPoolT::OBJECT_STRIDE) + "}"
+		"],\"total_reserved_bytes\":" + str(64 * PoolT::CHUNK_SIZE + 65536) + "}\n";
+	REQUIRE(mem::PoolRegistry::get().toJson(findPools(ids)) == expected);
+}
+
+TEST_CASE( "PoolRegistry exports a MemoryPool and an ObjectPool for Prometheus", "[PoolRegistry]" ) {
+	Pools pools;
+	std::vector<uint64_t> ids = pools.ids();
+
+	std::string memoryLabels = "{id=\"" + str(ids[0]) + "\",kind=\"MemoryPool\",type=\"" + mem::type_name<PoolT>() + "\",object_size=\"24\"} ";
+	std::string objectLabels = "{id=\"" + str(ids[1]) + "\",kind=\"ObjectPool\",type=\"RegistryPoint\",object_size=\"" + str(ObjectPoolT::OBJECT_STRIDE) + "\"} ";
+	std::string expected =
+		"# HELP mempool_capacity_objects Objects the pool has room for without growing\n"
+		"# TYPE mempool_capacity_objects gauge\n"
+		"mempool_capacity_objects" + memoryLabels + "64\n"
+		"mempool_capacity_objects" + objectLabels + str(ObjectPoolT::OBJECTS_PER_BLOCK) + "\n"
+		"# HELP mempool_live_objects Objects currently allocated from the pool\n"
+		"# TYPE mempool_live_objects gauge\n"
+		"mempool_live_objects" + memoryLabels + "2\n"
+		"mempool_live_objects" + objectLabels + "2\n"
+		"# HELP mempool_peak_objects Most objects allocated from the pool at once\n"
+		"# TYPE mempool_peak_objects gauge\n"
+		"mempool_peak_objects" + memoryLabels + "3\n"
+		"mempool_peak_objects" + objectLabels + "3\n"
+		"# HELP mempool_blocks Blocks the pool holds\n"
+		"# TYPE mempool_blocks gauge\n"
+		"mempool_blocks" + memoryLabels + "1\n"
+		"mempool_blocks" + objectLabels + "1\n"
+		"# HELP mempool_reserved_bytes Bytes the pool holds\n"
+		"# TYPE mempool_reserved_bytes gauge\n"
+		"mempool_reserved_bytes" + memoryLabels + str(64 * PoolT::CHUNK_SIZE) + "\n"
+		"mempool_reserved_bytes" + objectLabels + "65536\n"
+		"# HELP mempool_used_bytes Bytes taken up by live objects\n"
+		"# TYPE mempool_used_bytes gauge\n"
+		"mempool_used_bytes" + memoryLabels + "48\n"
+		"mempool_used_bytes" + objectLabels + str(2 * ObjectPoolT::OBJECT_STRIDE) + "\n";
+	REQUIRE(mem::PoolRegistry::get().toPrometheus(findPools(ids)) == expected);
+}
+
+TEST_CASE( "PoolRegistry writes a snapshot to a file", "[PoolRegistry]" ) {
+	Pools pools;
+	std::string path = "registry_test.json";
+
+	// nothing else allocates while the test runs, so the file holds what a snapshot taken now does
+	REQUIRE(mem::PoolRegistry::get().writeFile(path, mem::EXPORT_JSON));
+	std::ifstream file(path);
+	std::stringstream contents;
+	contents << file.rdbuf();
+	REQUIRE(contents.str() == mem::PoolRegistry::get().snapshot(mem::EXPORT_JSON));
+	std::vector<uint64_t> ids = pools.ids();
+	REQUIRE(contents.str().find("{\"id\":" + str(ids[0]) + ",\"kind\":\"MemoryPool\"") != std::string::npos);
+	REQUIRE(contents.str().find("{\"id\":" + str(ids[1]) + ",\"kind\":\"ObjectPool\"") != std::string::npos);
+
+	// the temporary was renamed over the file
+	REQUIRE(std::ifstream(path + ".tmp").fail());
+	std::remove(path.c_str());
+
+	REQUIRE_FALSE(mem::PoolRegistry::get().writeFile("no_such_directory/registry_test.json", mem::EXPORT_JSON));
+}
@@ -0,0 +1,79 @@
+#include "catch.hpp"
+#include <cstddef>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+#include "Allocator.hpp"
+#include "SmallObjectPoolPolicy.hpp"
+
+namespace {
+
+	// classes nothing else in the tests uses, so the registry entries below are this file's alone
+	struct report_classes
+	{
+		constexpr static const size_t CLASSES[] = { 24, 40, 72 };
+	};
+
+	struct Size20 { unsigned char bytes[20]; };
+	struct Size24 { unsigned char bytes[24]; };
+	struct Size33 { unsigned char bytes[33]; };
+
+	template<typename T>
+	using ReportAllocator = Allocator<T, small_object_pool_policy<T, 0, report_classes>>;
+
+	const mem::SizeClassInfo* findClass(const std::vector<mem::SizeClassInfo>& classes, size_t classSize) {
+		for (const auto& info : classes) {
+			if (info.classSize == classSize)
+				return &info;
+		}
+		return nullptr;
+	}
+
+}
+
+TEST_CASE( "sizes round up to the smallest class that fits", "[SizeClasses]" ) {
+	static_assert(mem::num_size_classes<report_classes>() == 3, "");
+	static_assert(mem::max_size_class<report_classes>() == 72, "");
+	static_assert(mem::size_class_of<report_classes>(1) == 24, "");
+	static_assert(mem::size_class_of<report_classes>(24) == 24, "");
+	static_assert(mem::size_class_of<report_classes>(25) == 40, "");
+	static_assert(mem::size_class_of<report_classes>(73) == 0, "");
+	static_assert(mem::size_class_index<report_classes>(40) == 1, "");
+	static_assert(mem::size_class_index<report_classes>(73) == 3, "");
+
+	REQUIRE(mem::size_class_of<mem::default_size_classes>(100) == 112);
+	REQUIRE(mem::size_class_of<mem::default_size_classes>(129) == 160);
+}
+
+TEST_CASE( "SizeClassRegistry reports the sizes in every class and their waste", "[SizeClasses]" ) {
+	ReportAllocator<Size20> small;
+	ReportAllocator<Size24> exact;
+	ReportAllocator<Size33> larger;
+
+	Size20* a = small.allocate(1);
+	Size24* b = exact.allocate(1);
+	Size33* c = larger.allocate(1);
+
+	auto classes = mem::SizeClassRegistry::get().getClasses();
+	const mem::SizeClassInfo* class24 = findClass(classes, 24);
+	const mem::SizeClassInfo* class40 = findClass(classes, 40);
+	REQUIRE(class24);
+	REQUIRE(class40);
+	REQUIRE((class24->objectSizes == std::set<size_t>{ 20, 24 }));
+	REQUIRE(class24->worstWaste() == 4);
+	REQUIRE(class24->capacity > 0);
+	REQUIRE(class24->reservedBytes >= class24->capacity * 24);
+	REQUIRE((class40->objectSizes == std::set<size_t>{ 33 }));
+	REQUIRE(class40->worstWaste() == 7);
+
+	std::string report = mem::SizeClassRegistry::get().report();
+	REQUIRE(report.find("20 (4, 16.7%)") != std::string::npos);
+	REQUIRE(report.find("24 (0, 0.0%)") != std::string::npos);
+	REQUIRE(report.find("33 (7, 17.5%)") != std::string::npos);
+	REQUIRE(report.find("total reserved: ") != std::string::npos);
+
+	small.deallocate(a, 1);
+	exact.deallocate(b, 1);
+	larger.deallocate(c, 1);
+}
@@ -0,0 +1,142 @@
+#include "catch.hpp"
+#include <cstddef>
+#include <memory>
+#include <set>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "Allocator.hpp"
+#include "SmallObjectPoolPolicy.hpp"
+
+namespace {
+
+	// classes nothing else in the tests uses, so the registry entries below are this file's alone
+	struct array_classes
+	{
+		constexpr static const size_t CLASSES[] = { 20, 44, 100 };
+	};
+
+	struct registry_classes
+	{
+		constexpr static const size_t CLASSES[] = { 28, 52, 116 };
+	};
+
+	struct Elem10 { unsigned char bytes[10]; };
+	struct alignas(64) Wide { unsigned char bytes[8]; };
+
+	typedef small_object_pool_policy<Elem10, 0, array_classes> ArrayPolicy;
+	typedef small_object_pool_policy<Elem10, 0, registry_classes> RegistryPolicy;
+
+	std::set<size_t> sizesIn(size_t classSize) {
+		for (const auto& info : mem::SizeClassRegistry::get().getClasses()) {
+			if (info.classSize == classSize)
+				return info.objectSizes;
+		}
+		return {};
+	}
+
+	bool aligned(const void* ptr, size_t alignment) { return (uintptr_t)ptr % alignment == 0; }
+
+}
+
+TEST_CASE( "small_object_pool_policy routes small arrays by their size in bytes", "[SmallObjectPool]" ) {
+	static_assert(ArrayPolicy::MAX_SMALL_ARRAY == 10, "");
+	Allocator<Elem10, ArrayPolicy> allocator;
+
+	// 2 x 10 bytes fill the smallest class, 3 x 10 the next one
+	unsigned long small = ArrayPolicy::class_pool_type<20>::getStats().allocs;
+	unsigned long middle = ArrayPolicy::class_pool_type<44>::getStats().allocs;
+	Elem10* two = allocator.allocate(2);
+	Elem10* three = allocator.allocate(3);
+	REQUIRE(ArrayPolicy::class_pool_type<20>::getStats().allocs > small);
+	REQUIRE(ArrayPolicy::class_pool_type<44>::getStats().allocs > middle);
+	memset(two, 2, 2 * sizeof(Elem10));
+	memset(three, 3, 3 * sizeof(Elem10));
+
+	// the longest pooled array and one past it
+	unsigned long large = ArrayPolicy::class_pool_type<100>::getStats().allocs;
+	Elem10* ten = allocator.allocate(10);
+	REQUIRE(ArrayPolicy::class_pool_type<100>::getStats().allocs > large);
+	large = ArrayPolicy::class_pool_type<100>::getStats().allocs;
+	Elem10* eleven = allocator.allocate(11);
+	REQUIRE(ArrayPolicy::class_pool_type<100>::getStats().allocs == large);
+
+	REQUIRE(two[1].bytes[9] == 2);
+	REQUIRE(three[2].bytes[9] == 3);
+
+	allocator.deallocate(two, 2);
+	allocator.deallocate(three, 3);
+	allocator.deallocate(ten, 10);
+	allocator.deallocate(eleven, 11);
+}
+
+TEST_CASE( "small arrays are recorded under the sizes actually allocated", "[SmallObjectPool][SizeClasses]" ) {
+	Allocator<Elem10, RegistryPolicy> allocator;
+	Elem10* one = allocator.allocate(1);
+	Elem10* three = allocator.allocate(3);
+	Elem10* nine = allocator.allocate(9);
+	Elem10* again = allocator.allocate(9);
+
+	// not 40 and 50 for the middle class or 60 to 110 for the largest, nothing allocated those
+	REQUIRE((sizesIn(28) == std::set<size_t>{ 10 }));
+	REQUIRE((sizesIn(52) == std::set<size_t>{ 30 }));
+	REQUIRE((sizesIn(116) == std::set<size_t>{ 90 }));
+
+	Elem10* four = allocator.allocate(4);
+	REQUIRE((sizesIn(52) == std::set<size_t>{ 30, 40 }));
+
+	allocator.deallocate(one, 1);
+	allocator.deallocate(three, 3);
+	allocator.deallocate(nine, 9);
+	allocator.deallocate(again, 9);
+	allocator.deallocate(four, 4);
+}
+
+TEST_CASE( "small_object_pool_policy keeps over-aligned objects aligned", "[SmallObjectPool]" ) {
+	typedef small_object_pool_policy<Wide> WidePolicy;
+	static_assert(WidePolicy::SIZE_CLASS == 64, "");
+	static_assert(WidePolicy::POOL_ALIGNMENT == 64, "");
+
+	Allocator<Wide, WidePolicy> allocator;
+	std::vector<Wide*> objects;
+	for (int i = 0; i < 500; ++i)
+		objects.push_back(allocator.allocate(1));
+	Wide* array = allocator.allocate(3);
+	Wide* big = allocator.allocate(10);
+
+	size_t misaligned = 0;
+	for (Wide* object : objects)
+		misaligned += !aligned(object, 64);
+	REQUIRE(misaligned == 0);
+	REQUIRE(aligned(array, 64));
+	REQUIRE(aligned(big, 64));
+
+	for (Wide* object : objects)
+		allocator.deallocate(object, 1);
+	allocator.deallocate(array, 3);
+	allocator.deallocate(big, 10);
+
+	// an alignment asked for carries over to the rebound node types
+	typedef Allocator<int, small_object_pool_policy<int, mem::CACHE_LINE_SIZE>> IntAllocator;
+	IntAllocator ints;
+	IntAllocator::rebind<short>::other shorts(ints);
+	int* a = ints.allocate(1);
+	short* b = shorts.allocate(5);
+	REQUIRE(aligned(a, 64));
+	REQUIRE(aligned(b, 64));
+	ints.deallocate(a, 1);
+	shorts.deallocate(b, 5);
+	REQUIRE((ints != Allocator<int, small_object_pool_policy<int>>()));
+}
+
+TEST_CASE( "small_object_pool_policy backs strings and vectors", "[SmallObjectPool]" ) {
+	typedef std::basic_string<char, std::char_traits<char>, Allocator<char, small_object_pool_policy<char>>> String;
+	std::vector<String, Allocator<String, small_object_pool_policy<String>>> strings;
+	for (int i = 0; i < 200; ++i)
+		strings.push_back(String(i % 100, 'x'));
+	size_t length = 0;
+	for (const String& string : strings)
+		length += string.size();
+	REQUIRE(length == 2 * 99 * 100 / 2);
+}
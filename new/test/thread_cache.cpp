@@ -0,0 +1,189 @@
+#include "catch.hpp"
+#include <cstddef>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+#include "ThreadCache.hpp"
+
+namespace {
+
+	// a pool no policy uses, so only these tests touch its depot
+	typedef mem::ThreadCache<mem::MemoryPool<40>> Cache;
+
+	const size_t MAGAZINE_SIZE = Cache::MAGAZINE_SIZE;
+
+	// every test starts from a depot without full magazines and a pool without live objects
+	void drainDepot() {
+		Cache::trim();
+		REQUIRE(Cache::getStats().liveObjects == 0);
+	}
+
+	// runs fn on a thread of its own, so it starts with empty magazines and retires them when done
+	template<typename FnT>
+	void onThread(FnT fn) {
+		std::thread thread(fn);
+		thread.join();
+	}
+
+}
+
+TEST_CASE( "ThreadCache fills a magazine at a time from the pool", "[ThreadCache]" ) {
+	drainDepot();
+
+	onThread([] {
+		// the first alloc fills a whole magazine, the next ones come out of it
+		std::vector<void*> ptrs;
+		ptrs.push_back(Cache::alloc());
+		REQUIRE(Cache::getStats().liveObjects == MAGAZINE_SIZE);
+		for (size_t i = 1; i < MAGAZINE_SIZE; ++i)
+			ptrs.push_back(Cache::alloc());
+		REQUIRE(Cache::getStats().liveObjects == MAGAZINE_SIZE);
+
+		// both magazines are empty now, the next alloc refills one
+		ptrs.push_back(Cache::alloc());
+		REQUIRE(Cache::getStats().liveObjects == 2 * MAGAZINE_SIZE);
+
+		REQUIRE(std::set<void*>(ptrs.begin(), ptrs.end()).size() == ptrs.size());
+		for (void* ptr : ptrs)
+			Cache::free(ptr);
+
+		// the frees land in the magazines, the pool still counts the chunks as handed out
+		REQUIRE(Cache::getStats().liveObjects == 2 * MAGAZINE_SIZE);
+	});
+
+	// two full magazines went to the depot when the thread exited
+	REQUIRE(Cache::getStats().liveObjects == 2 * MAGAZINE_SIZE);
+	drainDepot();
+}
+
+TEST_CASE( "ThreadCache flushes full magazines to the depot for other threads", "[ThreadCache]" ) {
+	drainDepot();
+
+	std::set<void*> flushed;
+	std::thread owner;
+	{
+		std::mutex mutex;
+		std::condition_variable flushedCv;
+		std::condition_variable doneCv;
+		bool isFlushed = false;
+		bool isDone = false;
+
+		// the owner keeps running so its magazines only reach the depot through flush()
+		owner = std::thread([&] {
+			std::vector<void*> ptrs;
+			for (size_t i = 0; i < MAGAZINE_SIZE; ++i)
+				ptrs.push_back(Cache::alloc());
+			for (void* ptr : ptrs)
+				Cache::free(ptr);
+			Cache::flush();
+
+			std::unique_lock<std::mutex> lock(mutex);
+			flushed.insert(ptrs.begin(), ptrs.end());
+			isFlushed = true;
+			flushedCv.notify_one();
+			doneCv.wait(lock, [&] { return isDone; });
+		});
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			flushedCv.wait(lock, [&] { return isFlushed; });
+		}
+		REQUIRE(Cache::getStats().liveObjects == MAGAZINE_SIZE);
+
+		// another thread gets the flushed magazine instead of a new one from the pool
+		onThread([&] {
+			for (size_t i = 0; i < MAGAZINE_SIZE; ++i)
+				REQUIRE(flushed.count(Cache::alloc()));
+			REQUIRE(Cache::getStats().liveObjects == MAGAZINE_SIZE);
+			for (void* ptr : flushed)
+				Cache::free(ptr);
+		});
+
+		std::lock_guard<std::mutex> lock(mutex);
+		isDone = true;
+		doneCv.notify_one();
+	}
+	owner.join();
+	drainDepot();
+}
+
+TEST_CASE( "ThreadCache takes frees from threads that didn't allocate", "[ThreadCache]" ) {
+	drainDepot();
+
+	const size_t COUNT = 10 * MAGAZINE_SIZE;
+	std::vector<void*> ptrs;
+	onThread([&] {
+		for (size_t i = 0; i < COUNT; ++i)
+			ptrs.push_back(Cache::alloc());
+	});
+	onThread([&] {
+		for (void* ptr : ptrs)
+			Cache::free(ptr);
+	});
+
+	// the freeing thread filled whole magazines and retired them to the depot, the next thread gets
+	// them back before the pool is asked for anything
+	std::set<void*> freed(ptrs.begin(), ptrs.end());
+	size_t live = Cache::getStats().liveObjects;
+	REQUIRE(live >= COUNT);
+	onThread([&] {
+		std::vector<void*> again;
+		for (size_t i = 0; i < COUNT; ++i) {
+			again.push_back(Cache::alloc());
+			REQUIRE(freed.count(again.back()));
+		}
+		REQUIRE(Cache::getStats().liveObjects == live);
+		for (void* ptr : again)
+			Cache::free(ptr);
+	});
+	drainDepot();
+}
+
+TEST_CASE( "ThreadCache retires a thread's magazines when it exits", "[ThreadCache]" ) {
+	drainDepot();
+
+	// the thread exits with a partly used magazine and a few objects still out.  The magazine goes
+	// back to the pool, only the objects stay live
+	std::vector<void*> kept;
+	onThread([&] {
+		std::vector<void*> ptrs;
+		for (size_t i = 0; i < 10; ++i)
+			ptrs.push_back(Cache::alloc());
+		for (size_t i = 0; i < 3; ++i)
+			Cache::free(ptrs[i]);
+		kept.assign(ptrs.begin() + 3, ptrs.end());
+	});
+	REQUIRE(Cache::getStats().liveObjects == kept.size());
+
+	for (void* ptr : kept)
+		Cache::free(ptr);
+	drainDepot();
+}
+
+TEST_CASE( "ThreadCache::trim gives the pool's memory back after a flush", "[ThreadCache]" ) {
+	drainDepot();
+
+	onThread([] {
+		std::vector<void*> ptrs;
+		for (size_t i = 0; i < 4000; ++i)
+			ptrs.push_back(Cache::alloc());
+		REQUIRE(Cache::getStats().reservedBytes >= 4000 * 40);
+		for (void* ptr : ptrs)
+			Cache::free(ptr);
+
+		// the thread's own magazines go back with the trim, nothing is cached anywhere else
+		REQUIRE(Cache::trim() > 0);
+		mem::PoolStats stats = Cache::getStats();
+		REQUIRE(stats.liveObjects == 0);
+		REQUIRE(stats.numBlocks == 0);
+		REQUIRE(stats.reservedBytes == 0);
+
+		// and the cache keeps working on a pool that grows again
+		void* ptr = Cache::alloc();
+		REQUIRE(ptr);
+		Cache::free(ptr);
+	});
+	drainDepot();
+}
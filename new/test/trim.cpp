@@ -0,0 +1,132 @@
+#include "catch.hpp"
+#include <cstddef>
+#include <memory>
+#include <string.h>
+#include <vector>
+#include "MemoryPool.hpp"
+
+namespace {
+
+	typedef mem::MemoryPool<32> PoolT;
+
+	std::vector<void*> allocMany(PoolT& pool, size_t count) {
+		std::vector<void*> ptrs;
+		for (size_t i = 0; i < count; ++i)
+			ptrs.push_back(pool.alloc());
+		return ptrs;
+	}
+
+	void freeAll(PoolT& pool, std::vector<void*>& ptrs) {
+		for (void* ptr : ptrs)
+			pool.free(ptr);
+		ptrs.clear();
+	}
+
+}
+
+TEST_CASE( "trim releases the blocks without live objects", "[Trim][MemoryPool]" ) {
+	std::unique_ptr<PoolT> pool = PoolT::create();
+	REQUIRE(pool->init(16));
+
+	std::vector<void*> first = allocMany(*pool, 16);
+	std::vector<void*> rest = allocMany(*pool, 100);
+	REQUIRE(pool->getNumBlocks() == 4);
+
+	SECTION( "every block once everything is freed" ) {
+		freeAll(*pool, first);
+		freeAll(*pool, rest);
+		size_t reserved = pool->getReservedBytes();
+		REQUIRE(pool->trim() == reserved);
+		REQUIRE(pool->getNumBlocks() == 0);
+		REQUIRE(pool->getCapacity() == 0);
+
+		// and grows again from scratch
+		void* ptr = pool->alloc();
+		REQUIRE(ptr);
+		REQUIRE(pool->getNumBlocks() == 1);
+		pool->free(ptr);
+	}
+
+	SECTION( "only the empty ones while some objects are live" ) {
+		freeAll(*pool, rest);
+		REQUIRE(pool->trim() > 0);
+		REQUIRE(pool->getNumBlocks() == 1);
+		REQUIRE(pool->getStats().liveObjects == 16);
+		freeAll(*pool, first);
+	}
+
+	SECTION( "keeping the free chunks asked for" ) {
+		freeAll(*pool, rest);
+		pool->trim(mem::TRIM_RELEASE, 100);
+		REQUIRE(pool->getCapacity() - 16 >= 100);
+		freeAll(*pool, first);
+	}
+}
+
+TEST_CASE( "a decommitted block is reused before a new one is allocated", "[Trim][MemoryPool]" ) {
+	std::unique_ptr<PoolT> pool = PoolT::create();
+	size_t created = 0;
+	pool->connectBlockCreationHandler([&](void*, size_t) { ++created; });
+	REQUIRE(pool->init(64));
+
+	std::vector<void*> ptrs = allocMany(*pool, 64);
+	freeAll(*pool, ptrs);
+	REQUIRE(created == 1);
+
+	size_t reserved = pool->getReservedBytes();
+	REQUIRE(pool->trim(mem::TRIM_DECOMMIT) == reserved);
+	REQUIRE(pool->getNumBlocks() == 1);  // kept as a spare
+	REQUIRE(pool->getCapacity() == 0);
+	REQUIRE(pool->getBlockUsage()[0].decommitted);
+
+	// the pages come back zeroed or as they were, either way they have to be writable again
+	unsigned long grows = pool->getStats().grows;
+	ptrs = allocMany(*pool, 64);
+	for (void* ptr : ptrs)
+		memset(ptr, 0xab, 32);
+	REQUIRE(created == 1);
+	REQUIRE(pool->getNumBlocks() == 1);
+	REQUIRE(pool->getCapacity() == 64);
+	REQUIRE(pool->getStats().grows == grows + 1);
+	REQUIRE_FALSE(pool->getBlockUsage()[0].decommitted);
+
+	// a release after a decommit frees the spare as well
+	freeAll(*pool, ptrs);
+	pool->trim(mem::TRIM_DECOMMIT_LAZY);
+	pool->trim(mem::TRIM_RELEASE);
+	REQUIRE(pool->getNumBlocks() == 0);
+}
+
+TEST_CASE( "a TrimPolicy gives back what a spike left behind", "[Trim][MemoryPool]" ) {
+	std::unique_ptr<PoolT> pool = PoolT::create();
+	REQUIRE(pool->init(64));
+	mem::TrimPolicy policy;
+	policy.enabled = true;
+	policy.checkInterval = 16;
+	pool->setTrimPolicy(policy);
+
+	std::vector<void*> spike = allocMany(*pool, 2000);
+	REQUIRE(pool->getNumBlocks() > 1);
+	size_t capacity = pool->getCapacity();
+	freeAll(*pool, spike);
+
+	// blocks go as they empty out, down to the one every pool keeps
+	REQUIRE(pool->getNumBlocks() == 1);
+	REQUIRE(pool->getCapacity() >= 64);
+	REQUIRE(pool->getCapacity() < capacity);
+}
+
+TEST_CASE( "a TrimPolicy doesn't regrow a pool that keeps emptying out", "[Trim][MemoryPool]" ) {
+	std::unique_ptr<PoolT> pool = PoolT::create();
+	REQUIRE(pool->init(64));
+	mem::TrimPolicy policy;
+	policy.enabled = true;
+	policy.checkInterval = 16;
+	pool->setTrimPolicy(policy);
+
+	unsigned long grows = pool->getStats().grows;
+	for (int i = 0; i < 1000; ++i)
+		pool->free(pool->alloc());
+	REQUIRE(pool->getStats().grows == grows);
+	REQUIRE(pool->getNumBlocks() == 1);
+}
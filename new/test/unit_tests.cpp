@@ -0,0 +1,4 @@
+#define CATCH_CONFIG_MAIN
+// Catch's signal handler doesn't compile against current glibc, where SIGSTKSZ is no longer a constant
+#define CATCH_CONFIG_NO_POSIX_SIGNALS
+#include "catch.hpp"
@@ -5,8 +5,15 @@
 #include <functional>
 #include <limits>
 #include <array>
+#include <atomic>
 #include <math.h>
+#include <string.h>
 #include <iostream>
+#include <new>
+#include "BlockProvider.hpp"
+#include "PoolRegistry.hpp"
+#include "BlockOccupancy.hpp"
+#include "Probes.hpp"
 
 class IObjectPool {
 public:
@@ -28,7 +35,8 @@ struct IsPowerOf2 {
     constexpr static const bool value = ((test != 0) && !(test & (test - 1)));
 };
 
-template<typename T>
+// ProviderT is where the pool's blocks come from, see BlockProvider.hpp
+template<typename T, typename ProviderT = mem::malloc_provider>
 class ObjectPool;
 
 class Handle {
@@ -100,8 +108,8 @@ private:
 
 
 
-template<typename T>
-class ObjectPool : public IObjectPool, public std::enable_shared_from_this<ObjectPool<T>> {
+template<typename T, typename ProviderT>
+class ObjectPool : public IObjectPool, public std::enable_shared_from_this<ObjectPool<T, ProviderT>> {
 
 	struct Object {
 		//LOOKUP
@@ -117,7 +125,8 @@ class ObjectPool : public IObjectPool, public std::enable_shared_from_this<Objec
 
 public:
 
-	constexpr static const size_t BLOCK_SIZE = 65536;
+	// a huge page provider gets whole huge pages, anything smaller would waste most of each one
+	constexpr static const size_t BLOCK_SIZE = ProviderT::HUGE_PAGES ? mem::HUGE_PAGE_SIZE : 65536;
 	constexpr static const size_t OBJECTS_PER_BLOCK = BLOCK_SIZE / sizeof(Object);
 	constexpr static const size_t OBJECT_STRIDE = sizeof(Object);
 	constexpr static const size_t MAX_BLOCKS = std::numeric_limits<IObjectPool::IndirectionBlock>::max();
@@ -126,9 +135,13 @@ public:
 private:
 
 	struct MemoryBlock {
-		MemoryBlock() : block(reinterpret_cast<Object*>(::operator new(BLOCK_SIZE))) { memset(block, 0, BLOCK_SIZE); }
+		MemoryBlock() : block(reinterpret_cast<Object*>(ProviderT::allocate(BLOCK_SIZE, alignof(Object)))) {
+			if (!block)
+				throw std::bad_alloc();
+			memset(block, 0, BLOCK_SIZE);
+		}
 		~MemoryBlock() {
-			::operator delete( reinterpret_cast<void*>(block) );
+			ProviderT::deallocate(reinterpret_cast<void*>(block), BLOCK_SIZE, alignof(Object));
 		}
 
 		Object& operator[](size_t index) {
@@ -140,10 +153,12 @@ private:
 
 public:
 
-	static std::shared_ptr<ObjectPool<T>> create() { return std::shared_ptr<ObjectPool<T>>(new ObjectPool<T>); }
+	static std::shared_ptr<ObjectPool> create() { return std::shared_ptr<ObjectPool>(new ObjectPool); }
 
 	ObjectPool() {
 		mBlocks[0] = new MemoryBlock;
+		MEM_PROBE3(objectpool_block_create, this, 0, BLOCK_SIZE);
+		mRegistryId = mem::PoolRegistry::get().add([this] { return describe(); });
 	}
 
 	template<typename...Args>
@@ -157,7 +172,10 @@ public:
 		if (block_id >= MAX_BLOCKS) {
 			throw std::bad_alloc();
 		} else if (block_id >= mNumBlocks) {
-			mBlocks[mNumBlocks++] = new MemoryBlock;
+			mBlocks[mNumBlocks] = new MemoryBlock;
+			MEM_PROBE3(objectpool_block_create, this, mNumBlocks, BLOCK_SIZE);
+			++mNumBlocks;
+			mPublishedBlocks.store(mNumBlocks, std::memory_order_relaxed);
 		}
 
 		auto & next_slot = mBlocks[block_id]->operator[](data_index);
@@ -191,6 +209,11 @@ public:
 			mOnCreateHandlerfn(next_slot.data);
 
 		++mBack;
+		if (mBack > mPeak) {
+			mPeak = mBack;
+			mPublishedPeak.store(mPeak, std::memory_order_relaxed);
+		}
+		mPublishedLive.store(mBack, std::memory_order_relaxed);
 
 		auto handle = Handle( lookup, lookup->serial, getWeakPtr() );
 
@@ -225,17 +248,60 @@ public:
 	void connectObjectCreationHandler(const std::function<void(const T&)>& fn) { mOnCreateHandlerfn = fn; }
 	void connectObjectDestructionHandler(const std::function<void(const T&)>& fn) { mOnDestoryHandlerfn = fn; }
 
-	void disconnectObjectCreationHandler() { mOnCreateHandlerFn = nullptr; }
-	void disconnectObjectDestructionHandler() { mOnDestroyHandlerFn = nullptr; }
+	void disconnectObjectCreationHandler() { mOnCreateHandlerfn = nullptr; }
+	void disconnectObjectDestructionHandler() { mOnDestoryHandlerfn = nullptr; }
+
+	// what the pool registry lists for this pool.  A snapshot may run on any thread, so it only reads
+	// the published copies of the counters
+	mem::PoolInfo describe() const {
+		size_t live = mPublishedLive.load(std::memory_order_relaxed);
+		size_t peak = mPublishedPeak.load(std::memory_order_relaxed);
+		size_t numBlocks = mPublishedBlocks.load(std::memory_order_relaxed);
+		mem::PoolInfo info;
+		info.id = mRegistryId;
+		info.kind = "ObjectPool";
+		info.typeName = mem::type_name<T>();
+		info.objectSize = OBJECT_STRIDE;
+		info.alignment = alignof(Object);
+		info.capacity = numBlocks * OBJECTS_PER_BLOCK;
+		info.liveObjects = live;
+		info.peakObjects = std::max(peak, live);
+		info.numBlocks = numBlocks;
+		info.reservedBytes = numBlocks * BLOCK_SIZE;
+		info.usedBytes = live * OBJECT_STRIDE;
+		return info;
+	}
+
+	// live objects per block.  Swap and pop keeps the live objects packed at the front, so every block
+	// is full up to the last one in use and the blocks after it are empty; it never hands them back
+	std::vector<mem::BlockUsage> getBlockUsage() const {
+		std::vector<mem::BlockUsage> usage;
+		for (size_t i = 0; i < mNumBlocks; ++i) {
+			size_t first = i * OBJECTS_PER_BLOCK;
+			size_t live = mBack > first ? std::min(mBack - first, OBJECTS_PER_BLOCK) : 0;
+			size_t used = mPeak > first ? std::min(mPeak - first, OBJECTS_PER_BLOCK) : 0;
+			usage.push_back(mem::BlockUsage{ OBJECTS_PER_BLOCK, live, OBJECTS_PER_BLOCK - used, OBJECTS_PER_BLOCK - live, false });
+		}
+		return usage;
+	}
+
+	// the share of slots in occupied blocks that are free, see BlockOccupancy.hpp
+	double getFragmentation() const { return mem::fragmentation_index(getBlockUsage()); }
+
+	// a text heatmap of getBlockUsage(), one character per block
+	std::string getOccupancyMap(unsigned int width = 64) const {
+		return mem::occupancy_map("ObjectPool<" + mem::type_name<T>() + ">", getBlockUsage(), width);
+	}
 
 	~ObjectPool() { 
+		mem::PoolRegistry::get().remove(mRegistryId);
 		for (int i = 0; i < mNumBlocks; i++)
 			delete mBlocks[i];
 	}
 
 private:
 
-    std::weak_ptr<IObjectPool> getWeakPtr() override { return std::enable_shared_from_this<ObjectPool<T>>::shared_from_this(); }
+    std::weak_ptr<IObjectPool> getWeakPtr() override { return std::enable_shared_from_this<ObjectPool>::shared_from_this(); }
 
 	void destroyObject(void* object) override {
 
@@ -255,6 +321,7 @@ private:
 		if ( obj.block_id*OBJECTS_PER_BLOCK + obj.data_index < mBack - 1) {
 
 			//"swap and pop"
+			MEM_PROBE3(objectpool_relocate, this, mBack - 1, obj.block_id*OBJECTS_PER_BLOCK + obj.data_index);
 
 			auto & living_slot = mBlocks[floor((mBack - 1) / OBJECTS_PER_BLOCK)]->operator[]((mBack - 1) % OBJECTS_PER_BLOCK);
 			auto & living_lookup = *living_slot.lookup;
@@ -284,12 +351,18 @@ private:
 
 		++mDestructionOffset;
 		--mBack;
+		mPublishedLive.store(mBack, std::memory_order_relaxed);
 	}
 
 	std::array< MemoryBlock*, MAX_BLOCKS > mBlocks;
 	size_t mBack{ 0 };
 	size_t mNumBlocks{ 1 };
 	size_t mDestructionOffset{ 0 };
+	size_t mPeak{ 0 };
+	std::atomic<size_t> mPublishedLive{ 0 };  // mBack, mPeak and mNumBlocks for describe(), only the owner writes them
+	std::atomic<size_t> mPublishedPeak{ 0 };
+	std::atomic<size_t> mPublishedBlocks{ 1 };
+	uint64_t mRegistryId{ 0 };
 	std::function<void(const T&)> mOnCreateHandlerfn{ nullptr };
 	std::function<void(const T&)> mOnDestoryHandlerfn{ nullptr };
 